@@ -0,0 +1,861 @@
+#include "AddonAudioModel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+// Include audio processing libraries
+#ifdef LLAMA_WHISPER_AVAILABLE
+    #include "whisper.h"
+#endif
+
+#ifdef LLAMA_DR_LIBS_AVAILABLE
+    #define DR_WAV_IMPLEMENTATION
+    #include "dr_wav.h"
+    #define DR_MP3_IMPLEMENTATION
+    #include "dr_mp3.h"
+    #define DR_FLAC_IMPLEMENTATION
+    #include "dr_flac.h"
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+AddonAudioModel::AddonAudioModel(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonAudioModel>(info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1) {
+        Napi::TypeError::New(env, "Expected 1 argument: audioModelPath").ThrowAsJavaScriptException();
+        return;
+    }
+
+    if (!info[0].IsString()) {
+        Napi::TypeError::New(env, "audioModelPath must be a string").ThrowAsJavaScriptException();
+        return;
+    }
+
+    this->audioModelPath = info[0].As<Napi::String>().Utf8Value();
+
+    // Parse options if provided
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+
+        if (options.Has("sampleRate") && options.Get("sampleRate").IsNumber()) {
+            this->sampleRate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
+        }
+
+        if (options.Has("language") && options.Get("language").IsString()) {
+            this->currentLanguage = options.Get("language").As<Napi::String>().Utf8Value();
+        }
+    }
+
+    detectAudioCapabilities();
+}
+
+AddonAudioModel::~AddonAudioModel() {
+    dispose();
+}
+
+void AddonAudioModel::dispose() {
+    if (disposed) return;
+
+    // an in-flight transcription holds whisperMutex while it uses the context,
+    // so taking it here keeps the context alive until that run finishes
+    std::lock_guard<std::mutex> lock(whisperMutex);
+
+    if (whisper_ctx != nullptr) {
+#ifdef LLAMA_WHISPER_AVAILABLE
+        whisper_free(whisper_ctx);
+#endif
+        whisper_ctx = nullptr;
+    }
+
+    audioModelLoaded = false;
+    disposed = true;
+}
+
+class AddonAudioModelProcessAudioWorker : public Napi::AsyncWorker {
+    public:
+        AddonAudioModel* model;
+        const float* inputData = nullptr;
+        size_t inputLength = 0;
+        int inputSampleRate = 0;
+        // the model's sample rate and language are snapshotted at queue time,
+        // so setSampleRate/setLanguage calls can't race with the worker thread
+        int targetSampleRate = 0;
+        std::string language;
+        bool generateTranscript = true;
+        std::vector<float> audio; // audio at the model's sample rate, owned by the worker
+        AddonAudioModel::ProcessAudioResult result;
+
+        // processAudio() path: references the input typed array instead of copying it;
+        // resampling and normalization run on the worker thread
+        AddonAudioModelProcessAudioWorker(const Napi::CallbackInfo& info, AddonAudioModel* model)
+            : Napi::AsyncWorker(info.Env(), "AddonAudioModelProcessAudioWorker"),
+              model(model),
+              targetSampleRate(model->sampleRate),
+              language(model->currentLanguage),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            model->Ref();
+
+            Napi::Float32Array audioArray = info[0].As<Napi::Float32Array>();
+            inputData = audioArray.Data();
+            inputLength = audioArray.ElementLength();
+            inputDataRef = Napi::Persistent(info[0]);
+            inputSampleRate = info[1].As<Napi::Number>().Int32Value();
+
+            parseOptions(info, 2);
+        }
+
+        // finishAudioStream() path: takes ownership of the accumulated chunks,
+        // which were already resampled to the model's rate as they arrived
+        AddonAudioModelProcessAudioWorker(const Napi::CallbackInfo& info, AddonAudioModel* model, std::vector<float> streamedAudio)
+            : Napi::AsyncWorker(info.Env(), "AddonAudioModelProcessAudioWorker"),
+              model(model),
+              targetSampleRate(model->sampleRate),
+              language(model->currentLanguage),
+              audio(std::move(streamedAudio)),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            model->Ref();
+            inputSampleRate = targetSampleRate;
+
+            parseOptions(info, 0);
+        }
+
+        ~AddonAudioModelProcessAudioWorker() {
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Reference<Napi::Value> inputDataRef;
+        Napi::Promise::Deferred deferred;
+
+        void parseOptions(const Napi::CallbackInfo& info, size_t optionsIndex) {
+            if (info.Length() > optionsIndex && info[optionsIndex].IsObject()) {
+                Napi::Object options = info[optionsIndex].As<Napi::Object>();
+                if (options.Has("generateTranscript") && options.Get("generateTranscript").IsBoolean()) {
+                    generateTranscript = options.Get("generateTranscript").As<Napi::Boolean>().Value();
+                }
+            }
+        }
+
+        void Execute() {
+            try {
+                if (inputData != nullptr) {
+                    // resampleAudio copies even when the rates match, so normalization
+                    // never mutates the JS-owned input buffer
+                    audio = model->resampleAudio(inputData, inputLength, inputSampleRate, targetSampleRate);
+                }
+
+                model->normalizeAudio(audio.data(), audio.size());
+                result = model->processAudioData(audio.data(), audio.size(), targetSampleRate, language, generateTranscript);
+            } catch (const std::exception& e) {
+                SetError(std::string("Audio processing failed: ") + e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"processAudioData\"");
+            }
+        }
+        void OnOK() {
+            // hand the embedding over to JS without copying it
+            auto* embeddingData = new std::vector<float>(std::move(result.embedding));
+            auto arrayBuffer = Napi::ArrayBuffer::New(
+                Env(), embeddingData->data(), embeddingData->size() * sizeof(float),
+                [](Napi::Env env, void* data, std::vector<float>* buffer) {
+                    delete buffer;
+                },
+                embeddingData
+            );
+
+            Napi::Object resultObj = Napi::Object::New(Env());
+            resultObj.Set("embedding", Napi::Float32Array::New(Env(), embeddingData->size(), arrayBuffer, 0));
+
+            if (generateTranscript) {
+                resultObj.Set("transcript", Napi::String::New(Env(), result.transcript));
+                resultObj.Set("confidence", Napi::Number::New(Env(), result.confidence));
+            }
+
+            deferred.Resolve(resultObj);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+class AddonAudioModelLoadModelWorker : public Napi::AsyncWorker {
+    public:
+        AddonAudioModel* model;
+
+        AddonAudioModelLoadModelWorker(const Napi::Env env, AddonAudioModel* model)
+            : Napi::AsyncWorker(env, "AddonAudioModelLoadModelWorker"),
+              model(model),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            model->Ref();
+        }
+        ~AddonAudioModelLoadModelWorker() {
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                if (!model->loadAudioModel()) {
+                    SetError("Failed to load audio model");
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"loadAudioModel\"");
+            }
+        }
+        void OnOK() {
+            deferred.Resolve(Napi::Boolean::New(Env(), true));
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonAudioModel::Init(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (disposed) {
+        Napi::Error::New(env, "Audio model is disposed").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    // reading and initializing the whisper model can take seconds,
+    // so it runs on a worker thread instead of blocking the JS thread
+    AddonAudioModelLoadModelWorker* worker = new AddonAudioModelLoadModelWorker(env, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonAudioModel::Dispose(const Napi::CallbackInfo& info) {
+    dispose();
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonAudioModel::ProcessAudio(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2) {
+        Napi::TypeError::New(env, "Expected 2 arguments: audioData, sampleRate").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!info[0].IsTypedArray() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Invalid argument types").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (disposed) {
+        Napi::Error::New(env, "Audio model is disposed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!audioModelLoaded) {
+        Napi::Error::New(env, "Audio model not loaded").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    AddonAudioModelProcessAudioWorker* worker = new AddonAudioModelProcessAudioWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonAudioModel::PushAudioChunk(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsTypedArray() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected 2 arguments: audioChunk, sampleRate").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (disposed) {
+        Napi::Error::New(env, "Audio model is disposed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!audioModelLoaded) {
+        Napi::Error::New(env, "Audio model not loaded").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Float32Array chunkArray = info[0].As<Napi::Float32Array>();
+    int chunkSampleRate = info[1].As<Napi::Number>().Int32Value();
+
+    // resampling happens per chunk as it arrives, so by the time the upload
+    // finishes only the model inference itself is left to run
+    if (chunkSampleRate != sampleRate) {
+        std::vector<float> resampled = resampleAudio(chunkArray.Data(), chunkArray.ElementLength(), chunkSampleRate, sampleRate);
+        pendingStreamAudio.insert(pendingStreamAudio.end(), resampled.begin(), resampled.end());
+    } else {
+        pendingStreamAudio.insert(pendingStreamAudio.end(), chunkArray.Data(), chunkArray.Data() + chunkArray.ElementLength());
+    }
+
+    return Napi::Number::From(env, pendingStreamAudio.size());
+}
+
+Napi::Value AddonAudioModel::FinishAudioStream(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (disposed) {
+        Napi::Error::New(env, "Audio model is disposed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!audioModelLoaded) {
+        Napi::Error::New(env, "Audio model not loaded").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (pendingStreamAudio.empty()) {
+        Napi::Error::New(env, "No audio chunks were pushed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    AddonAudioModelProcessAudioWorker* worker = new AddonAudioModelProcessAudioWorker(info, this, std::move(pendingStreamAudio));
+    pendingStreamAudio = std::vector<float>();
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonAudioModel::GetAudioCapabilities(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    Napi::Object caps = Napi::Object::New(env);
+    caps.Set("maxAudioFiles", Napi::Number::New(env, audioCaps.maxAudioFiles));
+    caps.Set("maxDuration", Napi::Number::New(env, audioCaps.maxDuration));
+    caps.Set("supportsSpeechToText", Napi::Boolean::New(env, audioCaps.supportsSpeechToText));
+
+    // Supported formats array
+    Napi::Array formats = Napi::Array::New(env, audioCaps.supportedFormats.size());
+    for (size_t i = 0; i < audioCaps.supportedFormats.size(); i++) {
+        formats[i] = Napi::String::New(env, audioCaps.supportedFormats[i]);
+    }
+    caps.Set("supportedFormats", formats);
+
+    // Supported sample rates array
+    Napi::Array sampleRates = Napi::Array::New(env, audioCaps.supportedSampleRates.size());
+    for (size_t i = 0; i < audioCaps.supportedSampleRates.size(); i++) {
+        sampleRates[i] = Napi::Number::New(env, audioCaps.supportedSampleRates[i]);
+    }
+    caps.Set("supportedSampleRates", sampleRates);
+
+    // Supported languages array
+    Napi::Array languages = Napi::Array::New(env, audioCaps.supportedLanguages.size());
+    for (size_t i = 0; i < audioCaps.supportedLanguages.size(); i++) {
+        languages[i] = Napi::String::New(env, audioCaps.supportedLanguages[i]);
+    }
+    caps.Set("supportedLanguages", languages);
+
+    return caps;
+}
+
+Napi::Value AddonAudioModel::SetSampleRate(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected number argument").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    int newSampleRate = info[0].As<Napi::Number>().Int32Value();
+
+    // Validate sample rate
+    auto& supported = audioCaps.supportedSampleRates;
+    if (std::find(supported.begin(), supported.end(), newSampleRate) == supported.end()) {
+        Napi::Error::New(env, "Unsupported sample rate").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!pendingStreamAudio.empty()) {
+        Napi::Error::New(env, "Cannot change the sample rate while an audio stream is in progress").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    this->sampleRate = newSampleRate;
+    return env.Undefined();
+}
+
+Napi::Value AddonAudioModel::SetLanguage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected string argument").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    std::string newLanguage = info[0].As<Napi::String>().Utf8Value();
+
+    if (!isValidLanguage(newLanguage)) {
+        Napi::Error::New(env, "Unsupported language").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    this->currentLanguage = newLanguage;
+    return env.Undefined();
+}
+
+bool AddonAudioModel::loadAudioModel() {
+    if (audioModelLoaded) return true;
+
+    try {
+#ifdef LLAMA_WHISPER_AVAILABLE
+        // the whisper context is loaded once and reused for every request;
+        // transcription runs are serialized on whisperMutex
+        whisper_ctx = whisper_init_from_file(audioModelPath.c_str());
+        if (whisper_ctx == nullptr) {
+            return false;
+        }
+
+        audioModelLoaded = true;
+        detectAudioCapabilities();
+        return true;
+#else
+        // Fallback implementation when Whisper is not available
+        return false;
+#endif
+    } catch (const std::exception& e) {
+        return false;
+    }
+}
+
+AddonAudioModel::ProcessAudioResult AddonAudioModel::processAudioData(
+    const float* audioData, size_t audioLength, int audioSampleRate, const std::string& language, bool generateTranscript
+) {
+    ProcessAudioResult result;
+
+#ifdef LLAMA_WHISPER_AVAILABLE
+    if (!audioModelLoaded || whisper_ctx == nullptr) {
+        throw std::runtime_error("Audio model not loaded");
+    }
+
+    // feature extraction is pure CPU work and doesn't touch the whisper context,
+    // so it runs without taking whisperMutex
+    result.embedding = extractAudioFeatures(audioData, audioLength, audioSampleRate);
+
+    // Generate transcript if requested
+    if (generateTranscript) {
+        result.transcript = transcribeAudio(audioData, audioLength, language, result.confidence);
+    }
+
+    return result;
+#else
+    throw std::runtime_error("Whisper support not available - compile with LLAMA_WHISPER_AVAILABLE");
+#endif
+}
+
+std::vector<float> AddonAudioModel::extractAudioFeatures(const float* audioData, size_t audioLength, int audioSampleRate) {
+#ifdef LLAMA_WHISPER_AVAILABLE
+    const int melBins = 80;
+
+    // pool the log-mel spectrogram over time: per-bin mean and standard deviation,
+    // giving a fixed-size embedding regardless of the audio duration
+    std::vector<float> melSpec = AudioUtils::computeMelSpectrogram(audioData, audioLength, audioSampleRate);
+    std::vector<float> features(melBins * 2, 0.0f);
+
+    const size_t frameCount = melSpec.size() / melBins;
+    if (frameCount == 0) {
+        return features;
+    }
+
+    for (size_t frame = 0; frame < frameCount; frame++) {
+        for (int bin = 0; bin < melBins; bin++) {
+            features[bin] += melSpec[frame * melBins + bin];
+        }
+    }
+    for (int bin = 0; bin < melBins; bin++) {
+        features[bin] /= frameCount;
+    }
+
+    for (size_t frame = 0; frame < frameCount; frame++) {
+        for (int bin = 0; bin < melBins; bin++) {
+            const float diff = melSpec[frame * melBins + bin] - features[bin];
+            features[melBins + bin] += diff * diff;
+        }
+    }
+    for (int bin = 0; bin < melBins; bin++) {
+        features[melBins + bin] = std::sqrt(features[melBins + bin] / frameCount);
+    }
+
+    return features;
+#else
+    return {};
+#endif
+}
+
+std::string AddonAudioModel::transcribeAudio(const float* audioData, size_t audioLength, const std::string& language, float& confidence) {
+    confidence = 0.0f;
+
+#ifdef LLAMA_WHISPER_AVAILABLE
+    if (!whisper_ctx) return "";
+
+    // the shared whisper context isn't thread-safe
+    std::lock_guard<std::mutex> lock(whisperMutex);
+
+    // Set up Whisper parameters
+    whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+    // Set language if specified
+    if (language != "auto") {
+        params.language = language.c_str();
+    }
+
+    params.print_realtime = false;
+    params.print_progress = false;
+    params.print_timestamps = false;
+    params.print_special = false;
+    params.translate = false;
+    params.no_context = false;
+    params.single_segment = true;
+
+    // Run inference
+    if (whisper_full(whisper_ctx, params, audioData, (int)audioLength) != 0) {
+        return "";
+    }
+
+    // Extract text and average the token probabilities into a confidence score
+    std::string result;
+    double probabilitySum = 0.0;
+    size_t tokenCount = 0;
+
+    const int n_segments = whisper_full_n_segments(whisper_ctx);
+    for (int i = 0; i < n_segments; i++) {
+        const char* text = whisper_full_get_segment_text(whisper_ctx, i);
+        if (text) {
+            result += text;
+        }
+
+        const int n_tokens = whisper_full_n_tokens(whisper_ctx, i);
+        for (int j = 0; j < n_tokens; j++) {
+            probabilitySum += whisper_full_get_token_p(whisper_ctx, i, j);
+            tokenCount++;
+        }
+    }
+
+    if (tokenCount > 0) {
+        confidence = (float)(probabilitySum / tokenCount);
+    }
+
+    return result;
+#else
+    return "";
+#endif
+}
+
+void AddonAudioModel::detectAudioCapabilities() {
+    // Set capabilities based on model type and compilation flags
+#ifdef LLAMA_WHISPER_AVAILABLE
+    audioCaps.supportsSpeechToText = true;
+    audioCaps.maxDuration = 600; // 10 minutes for Whisper
+#else
+    audioCaps.supportsSpeechToText = false;
+    audioCaps.maxDuration = 60; // Limited without proper audio support
+#endif
+}
+
+bool AddonAudioModel::isValidAudioFormat(const std::string& mimeType) {
+    return std::find(audioCaps.supportedFormats.begin(), audioCaps.supportedFormats.end(), mimeType)
+           != audioCaps.supportedFormats.end();
+}
+
+bool AddonAudioModel::isValidLanguage(const std::string& language) {
+    return language == "auto" ||
+           std::find(audioCaps.supportedLanguages.begin(), audioCaps.supportedLanguages.end(), language)
+           != audioCaps.supportedLanguages.end();
+}
+
+std::vector<float> AddonAudioModel::resampleAudio(const float* audioData, size_t length, int fromSampleRate, int toSampleRate) {
+    if (fromSampleRate == toSampleRate) {
+        return std::vector<float>(audioData, audioData + length);
+    }
+
+    if (length < 2) {
+        return std::vector<float>(audioData, audioData + length);
+    }
+
+    const double ratio = (double)toSampleRate / fromSampleRate;
+    const double step = (double)fromSampleRate / toSampleRate;
+    const size_t newLength = (size_t)(length * ratio);
+    std::vector<float> resampled(newLength);
+
+    // linear interpolation with the source position derived from the loop counter,
+    // so the loop body is branch-free and the compiler can vectorize it
+    const size_t lastIndex = length - 2;
+    for (size_t i = 0; i < newLength; i++) {
+        const double srcIndex = i * step;
+        const size_t index = std::min((size_t)srcIndex, lastIndex);
+        const float fraction = (float)(srcIndex - index);
+        resampled[i] = audioData[index] + fraction * (audioData[index + 1] - audioData[index]);
+    }
+
+    return resampled;
+}
+
+void AddonAudioModel::normalizeAudio(float* audioData, size_t length) {
+    // Find peak amplitude
+    float peak = 0.0f;
+    for (size_t i = 0; i < length; i++) {
+        peak = std::max(peak, std::abs(audioData[i]));
+    }
+
+    // Normalize to prevent clipping
+    if (peak > 0.0f && peak > 0.95f) {
+        float scale = 0.95f / peak;
+        for (size_t i = 0; i < length; i++) {
+            audioData[i] *= scale;
+        }
+    }
+}
+
+Napi::Function AddonAudioModel::GetClass(Napi::Env env) {
+    return DefineClass(env, "AddonAudioModel", {
+        InstanceMethod("init", &AddonAudioModel::Init),
+        InstanceMethod("dispose", &AddonAudioModel::Dispose),
+        InstanceMethod("processAudio", &AddonAudioModel::ProcessAudio),
+        InstanceMethod("pushAudioChunk", &AddonAudioModel::PushAudioChunk),
+        InstanceMethod("finishAudioStream", &AddonAudioModel::FinishAudioStream),
+        InstanceMethod("getAudioCapabilities", &AddonAudioModel::GetAudioCapabilities),
+        InstanceMethod("setSampleRate", &AddonAudioModel::SetSampleRate),
+        InstanceMethod("setLanguage", &AddonAudioModel::SetLanguage)
+    });
+}
+
+// AudioUtils namespace implementation
+namespace AudioUtils {
+    AudioData decodeAudio(const uint8_t* encodedData, size_t dataSize, const std::string& mimeType) {
+        AudioData result;
+
+#ifdef LLAMA_DR_LIBS_AVAILABLE
+        if (mimeType == "audio/wav" || mimeType == "audio/wave") {
+            drwav wav;
+            if (drwav_init_memory(&wav, encodedData, dataSize, nullptr)) {
+                result.length = wav.totalPCMFrameCount * wav.channels;
+                result.data = std::make_unique<float[]>(result.length);
+                result.sampleRate = (int)wav.sampleRate;
+                result.channels = wav.channels;
+                result.duration = (float)wav.totalPCMFrameCount / wav.sampleRate;
+
+                drwav_read_pcm_frames_f32(&wav, wav.totalPCMFrameCount, result.data.get());
+                drwav_uninit(&wav);
+            }
+        }
+        else if (mimeType == "audio/mp3" || mimeType == "audio/mpeg") {
+            drmp3_config config;
+            drmp3_uint64 totalFrames;
+            float* audioData = drmp3_open_memory_and_read_pcm_frames_f32(
+                encodedData, dataSize, &config, &totalFrames, nullptr);
+
+            if (audioData) {
+                result.length = totalFrames * config.channels;
+                result.data = std::unique_ptr<float[]>(audioData);
+                result.sampleRate = (int)config.sampleRate;
+                result.channels = config.channels;
+                result.duration = (float)totalFrames / config.sampleRate;
+            }
+        }
+        else if (mimeType == "audio/flac") {
+            drflac* flac = drflac_open_memory(encodedData, dataSize, nullptr);
+            if (flac) {
+                result.length = flac->totalPCMFrameCount * flac->channels;
+                result.data = std::make_unique<float[]>(result.length);
+                result.sampleRate = (int)flac->sampleRate;
+                result.channels = flac->channels;
+                result.duration = (float)flac->totalPCMFrameCount / flac->sampleRate;
+
+                drflac_read_pcm_frames_f32(flac, flac->totalPCMFrameCount, result.data.get());
+                drflac_close(flac);
+            }
+        }
+#endif
+
+        return result;
+    }
+
+    bool isSupportedAudioFormat(const std::string& mimeType) {
+        static const std::vector<std::string> supported = {
+            "audio/wav", "audio/wave", "audio/mp3", "audio/mpeg", "audio/flac", "audio/ogg"
+        };
+        return std::find(supported.begin(), supported.end(), mimeType) != supported.end();
+    }
+
+    void convertToMono(float* stereoData, size_t stereoLength, float* monoData) {
+        for (size_t i = 0; i < stereoLength / 2; i++) {
+            monoData[i] = (stereoData[i * 2] + stereoData[i * 2 + 1]) * 0.5f;
+        }
+    }
+
+    std::vector<float> applyPreEmphasis(const float* audioData, size_t length, float factor) {
+        std::vector<float> emphasized(length);
+        emphasized[0] = audioData[0];
+
+        for (size_t i = 1; i < length; i++) {
+            emphasized[i] = audioData[i] - factor * audioData[i - 1];
+        }
+
+        return emphasized;
+    }
+
+    // iterative radix-2 FFT over interleaved real/imaginary buffers;
+    // sized for the fixed 512-point frames below, so no allocations per frame
+    static void fftInPlace(float* re, float* im, size_t n) {
+        for (size_t i = 1, j = 0; i < n; i++) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+
+            if (i < j) {
+                std::swap(re[i], re[j]);
+                std::swap(im[i], im[j]);
+            }
+        }
+
+        for (size_t len = 2; len <= n; len <<= 1) {
+            const float angle = -2.0f * (float)M_PI / (float)len;
+            const float stepRe = std::cos(angle);
+            const float stepIm = std::sin(angle);
+
+            for (size_t i = 0; i < n; i += len) {
+                float curRe = 1.0f;
+                float curIm = 0.0f;
+
+                for (size_t k = 0; k < len / 2; k++) {
+                    const float evenRe = re[i + k];
+                    const float evenIm = im[i + k];
+                    const float oddRe = re[i + k + len / 2] * curRe - im[i + k + len / 2] * curIm;
+                    const float oddIm = re[i + k + len / 2] * curIm + im[i + k + len / 2] * curRe;
+
+                    re[i + k] = evenRe + oddRe;
+                    im[i + k] = evenIm + oddIm;
+                    re[i + k + len / 2] = evenRe - oddRe;
+                    im[i + k + len / 2] = evenIm - oddIm;
+
+                    const float nextRe = curRe * stepRe - curIm * stepIm;
+                    curIm = curRe * stepIm + curIm * stepRe;
+                    curRe = nextRe;
+                }
+            }
+        }
+    }
+
+    static float hzToMel(float hz) {
+        return 2595.0f * std::log10(1.0f + hz / 700.0f);
+    }
+
+    static float melToHz(float mel) {
+        return 700.0f * (std::pow(10.0f, mel / 2595.0f) - 1.0f);
+    }
+
+    std::vector<float> computeMelSpectrogram(const float* audioData, size_t length, int sampleRate) {
+        const size_t frameSize = 400; // 25ms at 16kHz
+        const size_t hopSize = 160; // 10ms at 16kHz
+        const size_t fftSize = 512;
+        const size_t spectrumBins = fftSize / 2 + 1;
+        const int melBins = 80;
+
+        if (length < frameSize) {
+            return {};
+        }
+
+        const size_t frameCount = 1 + (length - frameSize) / hopSize;
+
+        // Hann window
+        std::vector<float> window(frameSize);
+        for (size_t i = 0; i < frameSize; i++) {
+            window[i] = 0.5f * (1.0f - std::cos(2.0f * (float)M_PI * (float)i / (float)(frameSize - 1)));
+        }
+
+        // triangular mel filter bank over the power spectrum
+        std::vector<float> filterBank((size_t)melBins * spectrumBins, 0.0f);
+        const float melMax = hzToMel((float)sampleRate / 2.0f);
+        for (int mel = 0; mel < melBins; mel++) {
+            const float leftHz = melToHz(melMax * (float)mel / (float)(melBins + 1));
+            const float centerHz = melToHz(melMax * (float)(mel + 1) / (float)(melBins + 1));
+            const float rightHz = melToHz(melMax * (float)(mel + 2) / (float)(melBins + 1));
+
+            for (size_t bin = 0; bin < spectrumBins; bin++) {
+                const float binHz = (float)bin * (float)sampleRate / (float)fftSize;
+
+                if (binHz > leftHz && binHz < centerHz) {
+                    filterBank[(size_t)mel * spectrumBins + bin] = (binHz - leftHz) / (centerHz - leftHz);
+                } else if (binHz >= centerHz && binHz < rightHz) {
+                    filterBank[(size_t)mel * spectrumBins + bin] = (rightHz - binHz) / (rightHz - centerHz);
+                }
+            }
+        }
+
+        std::vector<float> melSpec(frameCount * (size_t)melBins);
+
+        // frames are independent, so they're split across a pool of worker
+        // threads; each thread reuses its own FFT buffers across its frames
+        const auto processFrames = [&](size_t firstFrame, size_t lastFrame) {
+            std::vector<float> re(fftSize);
+            std::vector<float> im(fftSize);
+            std::vector<float> power(spectrumBins);
+
+            for (size_t frame = firstFrame; frame < lastFrame; frame++) {
+                const float* frameData = audioData + frame * hopSize;
+
+                for (size_t i = 0; i < frameSize; i++) {
+                    re[i] = frameData[i] * window[i];
+                }
+                std::fill(re.begin() + frameSize, re.end(), 0.0f);
+                std::fill(im.begin(), im.end(), 0.0f);
+
+                fftInPlace(re.data(), im.data(), fftSize);
+
+                for (size_t bin = 0; bin < spectrumBins; bin++) {
+                    power[bin] = re[bin] * re[bin] + im[bin] * im[bin];
+                }
+
+                for (int mel = 0; mel < melBins; mel++) {
+                    const float* filter = filterBank.data() + (size_t)mel * spectrumBins;
+                    float sum = 0.0f;
+                    for (size_t bin = 0; bin < spectrumBins; bin++) {
+                        sum += filter[bin] * power[bin];
+                    }
+
+                    melSpec[frame * (size_t)melBins + mel] = std::log10(std::max(sum, 1e-10f));
+                }
+            }
+        };
+
+        size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        threadCount = std::min(threadCount, frameCount);
+
+        if (threadCount <= 1) {
+            processFrames(0, frameCount);
+        } else {
+            std::vector<std::thread> workers;
+            workers.reserve(threadCount);
+
+            const size_t framesPerThread = (frameCount + threadCount - 1) / threadCount;
+            for (size_t t = 0; t < threadCount; t++) {
+                const size_t firstFrame = t * framesPerThread;
+                const size_t lastFrame = std::min(firstFrame + framesPerThread, frameCount);
+                workers.emplace_back(processFrames, firstFrame, lastFrame);
+            }
+
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        return melSpec;
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "napi.h"
 #include "addonGlobals.h"
+#include <mutex>
 #include <vector>
 #include <memory>
 #include <string>
@@ -17,6 +18,11 @@ class AddonAudioModel : public Napi::ObjectWrap<AddonAudioModel> {
         std::string currentLanguage = "auto";
         int sampleRate = 16000;
 
+        // the whisper context is reused across requests; it isn't thread-safe,
+        // so inference runs are serialized on this mutex while feature
+        // extraction (pure CPU, no context) runs unserialized
+        std::mutex whisperMutex;
+
         // Audio capabilities
         struct AudioCapabilities {
             int maxAudioFiles = 1;
@@ -41,27 +47,34 @@ class AddonAudioModel : public Napi::ObjectWrap<AddonAudioModel> {
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
         Napi::Value ProcessAudio(const Napi::CallbackInfo& info);
+        Napi::Value PushAudioChunk(const Napi::CallbackInfo& info);
+        Napi::Value FinishAudioStream(const Napi::CallbackInfo& info);
         Napi::Value GetAudioCapabilities(const Napi::CallbackInfo& info);
         Napi::Value SetSampleRate(const Napi::CallbackInfo& info);
         Napi::Value SetLanguage(const Napi::CallbackInfo& info);
 
         static Napi::Function GetClass(Napi::Env env);
 
+        ProcessAudioResult processAudioData(
+            const float* audioData, size_t audioLength, int audioSampleRate, const std::string& language, bool generateTranscript = true
+        );
+        std::vector<float> resampleAudio(const float* audioData, size_t length, int fromSampleRate, int toSampleRate);
+        void normalizeAudio(float* audioData, size_t length);
+        bool loadAudioModel();
+
     private:
         bool disposed = false;
 
-        // Internal audio processing methods
-        bool loadAudioModel();
-        ProcessAudioResult processAudioData(const float* audioData, size_t audioLength, bool generateTranscript = true);
-        std::vector<float> extractAudioFeatures(const float* audioData, size_t audioLength);
-        std::string transcribeAudio(const float* audioData, size_t audioLength);
+        // audio pushed via pushAudioChunk, already resampled to the model rate;
+        // finishAudioStream consumes it
+        std::vector<float> pendingStreamAudio;
+        std::vector<float> extractAudioFeatures(const float* audioData, size_t audioLength, int audioSampleRate);
+        std::string transcribeAudio(const float* audioData, size_t audioLength, const std::string& language, float& confidence);
 
         // Helper methods
         void detectAudioCapabilities();
         bool isValidAudioFormat(const std::string& mimeType);
         bool isValidLanguage(const std::string& language);
-        std::vector<float> resampleAudio(const float* audioData, size_t length, int fromSampleRate, int toSampleRate);
-        void normalizeAudio(float* audioData, size_t length);
 };
 
 // Helper functions for audio processing
@@ -79,4 +92,4 @@ namespace AudioUtils {
     void convertToMono(float* stereoData, size_t stereoLength, float* monoData);
     std::vector<float> applyPreEmphasis(const float* audioData, size_t length, float factor = 0.97f);
     std::vector<float> computeMelSpectrogram(const float* audioData, size_t length, int sampleRate);
-}
\ No newline at end of file
+}
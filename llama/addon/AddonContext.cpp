@@ -1,13 +1,25 @@
 #include <thread>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include "common/common.h"
 #include "llama.h"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #include "addonGlobals.h"
 #include "AddonModel.h"
+#include "AddonModelData.h"
 #include "AddonModelLora.h"
 #include "AddonGrammarEvaluationState.h"
+#include "AddonThreadpool.h"
+#include "InferenceThread.h"
 #include "AddonContext.h"
 
 static uint64_t calculateBatchMemorySize(int32_t n_tokens_alloc, int32_t embd, int32_t n_seq_max) {
@@ -30,6 +42,42 @@ static uint64_t calculateBatchMemorySize(int32_t n_tokens_alloc, int32_t embd, i
     return totalSize;
 }
 
+static std::string decodeBatchSync(llama_context* ctx, llama_batch& batch) {
+    // Perform the evaluation using llama_decode.
+    int r = llama_decode(ctx, batch);
+
+    if (r != 0) {
+        if (r == 1) {
+            return "could not find a KV slot for the batch (try reducing the size of the batch or increase the context)";
+        }
+
+        return "Eval has failed";
+    }
+
+    llama_synchronize(ctx);
+    return "";
+}
+
+static uint64_t elapsedTimeUs(const std::chrono::steady_clock::time_point startTime) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count()
+    );
+}
+
+static std::string decodeBatchSync(AddonContext* ctx, llama_batch& batch) {
+    const auto startTime = std::chrono::steady_clock::now();
+    const auto batchTokens = batch.n_tokens;
+
+    const auto error = decodeBatchSync(ctx->ctx, batch);
+
+    ctx->recordDecodeTime(elapsedTimeUs(startTime), batchTokens);
+    return error;
+}
+
+static std::string decodeBatchSync(AddonContext* ctx) {
+    return decodeBatchSync(ctx, ctx->batch);
+}
+
 class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
     public:
         AddonContext* ctx;
@@ -37,6 +85,7 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
         AddonContextDecodeBatchWorker(const Napi::Env& env, AddonContext* ctx)
             : Napi::AsyncWorker(env, "AddonContextDecodeBatchWorker"),
               ctx(ctx),
+              queuedTime(std::chrono::steady_clock::now()),
               deferred(Napi::Promise::Deferred::New(env)) {
             ctx->Ref();
         }
@@ -49,24 +98,18 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
         }
 
     protected:
+        std::chrono::steady_clock::time_point queuedTime;
         Napi::Promise::Deferred deferred;
 
         void Execute() {
-            try {
-                // Perform the evaluation using llama_decode.
-                int r = llama_decode(ctx->ctx, ctx->batch);
+            ctx->recordQueueWait(elapsedTimeUs(queuedTime));
 
-                if (r != 0) {
-                    if (r == 1) {
-                        SetError("could not find a KV slot for the batch (try reducing the size of the batch or increase the context)");
-                    } else {
-                        SetError("Eval has failed");
-                    }
+            try {
+                const auto error = decodeBatchSync(ctx);
 
-                    return;
+                if (!error.empty()) {
+                    SetError(error);
                 }
-
-                llama_synchronize(ctx->ctx);
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -104,6 +147,22 @@ class AddonContextLoadContextWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
+                if (context->poolable && context->model->data != nullptr) {
+                    llama_context* pooledContext = context->model->data->checkOutContext(context->contextParamsHash);
+
+                    if (pooledContext != nullptr) {
+                        // a warm context only needs its sequences and perf counters cleared;
+                        // the KV cache allocation is reused as-is
+                        llama_memory_seq_rm(llama_get_memory(pooledContext), -1, -1, -1);
+                        llama_perf_context_reset(pooledContext);
+                        llama_set_n_threads(pooledContext, context->context_params.n_threads, context->context_params.n_threads_batch);
+
+                        context->ctx = pooledContext;
+                        context->contextLoaded = true;
+                        return;
+                    }
+                }
+
                 context->ctx = llama_init_from_model(context->model->model, context->context_params);
 
                 context->contextLoaded = context->ctx != nullptr && context->ctx != NULL;
@@ -149,7 +208,14 @@ class AddonContextUnloadContextWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                llama_free(context->ctx);
+                bool pooled = false;
+                if (context->poolable && context->model->data != nullptr && !context->model->disposed) {
+                    pooled = context->model->data->checkInContext(context->contextParamsHash, context->ctx);
+                }
+
+                if (!pooled) {
+                    llama_free(context->ctx);
+                }
                 context->contextLoaded = false;
 
                 try {
@@ -157,6 +223,7 @@ class AddonContextUnloadContextWorker : public Napi::AsyncWorker {
                         llama_batch_free(context->batch);
                         context->has_batch = false;
                         context->batch_n_tokens = 0;
+                        context->batch_allocated_tokens = 0;
                     }
 
                     context->dispose();
@@ -199,12 +266,15 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
         llama_token * probabilities_tokens;
         float * probabilities_probs;
         int32_t batchLogitIndex;
+        int32_t maxProbabilities = 0; // 0 = return probabilities for the whole vocabulary
+        std::vector<float> logitsBuffer;
         llama_token result;
         bool no_output = false;
 
         AddonContextSampleTokenWorker(const Napi::CallbackInfo& info, AddonContext* ctx)
             : Napi::AsyncWorker(info.Env(), "AddonContextSampleTokenWorker"),
               ctx(ctx),
+              queuedTime(std::chrono::steady_clock::now()),
               deferred(Napi::Promise::Deferred::New(info.Env())) {
             ctx->Ref();
 
@@ -213,6 +283,7 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
             arrayResult = info.Length() > 2 && info[2].IsBoolean();
             returnProbabilities = arrayResult ? info[2].As<Napi::Boolean>().Value() : false;
             returnConfidence = arrayResult && info.Length() > 3 && info[3].IsBoolean() ? info[3].As<Napi::Boolean>().Value() : false;
+            maxProbabilities = info.Length() > 4 && info[4].IsNumber() ? info[4].As<Napi::Number>().Int32Value() : 0;
             sampler->Ref();
         }
         ~AddonContextSampleTokenWorker() {
@@ -229,23 +300,46 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
             return deferred.Promise();
         }
 
-    protected:
-        Napi::Promise::Deferred deferred;
+        // runs on the dedicated inference thread. returns an error message, or an empty string on success
+        std::string RunSync() {
+            ctx->recordQueueWait(elapsedTimeUs(queuedTime));
 
-        void Execute() {
             try {
-                SampleToken();
+                const auto startTime = std::chrono::steady_clock::now();
+                const std::string error = SampleToken();
+                ctx->recordSamplerTime(elapsedTimeUs(startTime));
+                return error;
             } catch (const std::exception& e) {
-                SetError(e.what());
+                return e.what();
             } catch(...) {
-                SetError("Unknown error when calling \"SampleToken\"");
+                return "Unknown error when calling \"SampleToken\"";
+            }
+        }
+
+        // runs on the JS thread after "RunSync" has finished
+        void CompleteSync(Napi::Env env, const std::string & error) {
+            if (error.empty()) {
+                OnOK();
+            } else {
+                deferred.Reject(Napi::Error::New(env, error).Value());
+            }
+        }
+
+    protected:
+        std::chrono::steady_clock::time_point queuedTime;
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            const std::string error = RunSync();
+
+            if (!error.empty()) {
+                SetError(error);
             }
         }
 
-        void SampleToken() {
+        std::string SampleToken() {
             if (llama_get_logits(ctx->ctx) == nullptr) {
-                SetError("This model does not support token generation");
-                return;
+                return "This model does not support token generation";
             }
 
             sampler->rebuildChainIfNeeded();
@@ -269,84 +363,72 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
 
             if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
                 no_output = true;
-                return;
+                return "";
             }
 
             auto new_token_id = cur_p.data[cur_p.selected].id;
+            const float selectedLogit = cur_p.data[cur_p.selected].logit;
 
             if (returnProbabilities || returnConfidence) {
-                if (!cur_p.sorted) {
-                    std::sort(cur_p.data, cur_p.data + cur_p.size, [](const llama_token_data & a, const llama_token_data & b) {
-                        return a.logit > b.logit;
-                    });
-                    cur_p.sorted = true;
-
-                    for (size_t i = 0; i < cur_p.size; i++) {
-                        if (cur_p.data[i].id == new_token_id) {
-                            cur_p.selected = i;
-                            break;
-                        }
-                    }
+                // compute the softmax denominator over all of the post-chain candidates without sorting them.
+                // the logits are copied into a contiguous buffer and processed in separate max/exp passes,
+                // so compilers can vectorize the loops
+                const size_t candidatesCount = cur_p.size;
+                logitsBuffer.resize(candidatesCount);
+                for (size_t i = 0; i < candidatesCount; i++) {
+                    logitsBuffer[i] = cur_p.data[i].logit;
                 }
-            }
-
-            if (returnProbabilities) {
-                probabilities_size = cur_p.size;
-                probabilities_tokens = new llama_token[probabilities_size];
-                probabilities_probs = new float[probabilities_size];
-                float maxLogit = cur_p.size > 0 ? cur_p.data[0].logit : -INFINITY;
 
-                for (size_t i = 0; i < cur_p.size; i++) {
-                    auto logit = cur_p.data[i].logit;
-
-                    probabilities_tokens[i] = cur_p.data[i].id;
-                    probabilities_probs[i] = logit;
-
-                    if (logit > maxLogit) {
-                        maxLogit = logit;
-                    }
+                float maxLogit = -INFINITY;
+                for (size_t i = 0; i < candidatesCount; i++) {
+                    maxLogit = std::max(maxLogit, logitsBuffer[i]);
                 }
 
-                if (probabilities_size > 0 && maxLogit != -INFINITY) {
-                    float sum = 0.0f;
-                    for (size_t i = 0; i < probabilities_size; i++) {
-                        float prob = expf(probabilities_probs[i] - maxLogit);
-                        probabilities_probs[i] = prob;
-                        sum += prob;
-                    }
-
-                    for (size_t i = 0; i < probabilities_size; i++) {
-                        probabilities_probs[i] /= sum;
+                float sum = 0.0f;
+                if (candidatesCount > 0 && maxLogit != -INFINITY) {
+                    for (size_t i = 0; i < candidatesCount; i++) {
+                        sum += expf(logitsBuffer[i] - maxLogit);
                     }
                 }
 
-                has_probabilities = true;
-            }
-
-            if (returnConfidence) {
-                if (has_probabilities && cur_p.selected < probabilities_size) {
-                    tokenConfidence = probabilities_probs[cur_p.selected];
-                } else {
-                    float maxLogit = cur_p.data[0].logit;
-                    float sum = 0.0f;
-                    for (size_t i = 0; i < cur_p.size; i++) {
-                        auto logit = cur_p.data[i].logit;
-
-                        if (logit > maxLogit) {
-                            maxLogit = logit;
+                if (returnProbabilities) {
+                    const auto compareLogits = [](const llama_token_data & a, const llama_token_data & b) {
+                        return a.logit > b.logit;
+                    };
+                    const size_t topCount = maxProbabilities > 0
+                        ? std::min(static_cast<size_t>(maxProbabilities), candidatesCount)
+                        : candidatesCount;
+
+                    if (!cur_p.sorted) {
+                        if (topCount < candidatesCount) {
+                            // extract only the requested top tokens instead of sorting the whole vocabulary
+                            std::partial_sort(cur_p.data, cur_p.data + topCount, cur_p.data + candidatesCount, compareLogits);
+                        } else {
+                            std::sort(cur_p.data, cur_p.data + candidatesCount, compareLogits);
+                            cur_p.sorted = true;
                         }
                     }
 
-                    for (size_t i = 0; i < cur_p.size; i++) {
-                        sum += expf(cur_p.data[i].logit - maxLogit);
+                    probabilities_size = topCount;
+                    probabilities_tokens = new llama_token[probabilities_size];
+                    probabilities_probs = new float[probabilities_size];
+
+                    for (size_t i = 0; i < topCount; i++) {
+                        probabilities_tokens[i] = cur_p.data[i].id;
+                        probabilities_probs[i] = sum > 0.0f ? expf(cur_p.data[i].logit - maxLogit) / sum : 0.0f;
                     }
 
-                    tokenConfidence = expf(cur_p.data[cur_p.selected].logit - maxLogit) / sum;
+                    has_probabilities = true;
+                }
+
+                if (returnConfidence && sum > 0.0f) {
+                    tokenConfidence = expf(selectedLogit - maxLogit) / sum;
                 }
             }
 
             sampler->acceptToken(new_token_id);
             result = new_token_id;
+            return "";
         }
         void OnOK() {
             Napi::Number resultToken;
@@ -365,12 +447,28 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
             resultArray.Set(Napi::Number::New(Env(), 0), resultToken);
 
             if (has_probabilities) {
-                Napi::Array probabilities = Napi::Array::New(Env(), probabilities_size * 2);
-                for (size_t i = 0; i < probabilities_size; i++) {
-                    probabilities.Set(i * 2, Napi::Number::New(Env(), probabilities_tokens[i]));
-                    probabilities.Set(i * 2 + 1, Napi::Number::New(Env(), probabilities_probs[i]));
-                }
+                // wrap the natively-owned buffers in typed arrays instead of boxing every token/probability pair,
+                // so the results cross the JS boundary as a single pointer each
+                Napi::ArrayBuffer tokensBuffer = Napi::ArrayBuffer::New(
+                    Env(), probabilities_tokens, probabilities_size * sizeof(llama_token),
+                    [](Napi::Env env, void* data) {
+                        delete[] static_cast<llama_token*>(data);
+                    }
+                );
+                Napi::ArrayBuffer probsBuffer = Napi::ArrayBuffer::New(
+                    Env(), probabilities_probs, probabilities_size * sizeof(float),
+                    [](Napi::Env env, void* data) {
+                        delete[] static_cast<float*>(data);
+                    }
+                );
+
+                Napi::Array probabilities = Napi::Array::New(Env(), 2);
+                probabilities.Set((uint32_t)0, Napi::Uint32Array::New(Env(), probabilities_size, tokensBuffer, 0));
+                probabilities.Set((uint32_t)1, Napi::Float32Array::New(Env(), probabilities_size, probsBuffer, 0));
                 resultArray.Set(1, probabilities);
+
+                // the finalizers own the buffers now
+                has_probabilities = false;
             }
 
             if (returnConfidence && tokenConfidence != -1) {
@@ -384,354 +482,1998 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
         }
 };
 
-AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonContext>(info) {
-    model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
-    model->Ref();
+class AddonContextSampleTokensWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* ctx;
+        std::vector<AddonSampler*> samplers;
+        std::vector<int32_t> logitIndexes;
+        std::vector<llama_token> results;
 
-    context_params = llama_context_default_params();
-    context_params.n_ctx = 4096;
-    context_params.n_threads = std::max(cpu_get_num_math(), 1);
-    context_params.n_threads_batch = context_params.n_threads;
-    context_params.no_perf = true;
-    context_params.swa_full = false;
+        AddonContextSampleTokensWorker(const Napi::CallbackInfo& info, AddonContext* ctx)
+            : Napi::AsyncWorker(info.Env(), "AddonContextSampleTokensWorker"),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            ctx->Ref();
 
-    if (info.Length() > 1 && info[1].IsObject()) {
-        Napi::Object options = info[1].As<Napi::Object>();
+            Napi::Uint32Array logitIndexesArray = info[0].As<Napi::Uint32Array>();
+            Napi::Array samplersArray = info[1].As<Napi::Array>();
 
-        if (options.Has("contextSize")) {
-            context_params.n_ctx = options.Get("contextSize").As<Napi::Number>().Uint32Value();
-        }
+            logitIndexes.reserve(logitIndexesArray.ElementLength());
+            for (size_t i = 0; i < logitIndexesArray.ElementLength(); i++) {
+                logitIndexes.push_back(static_cast<int32_t>(logitIndexesArray[i]));
+            }
 
-        if (options.Has("batchSize")) {
-            context_params.n_batch = options.Get("batchSize").As<Napi::Number>().Uint32Value();
-            context_params.n_ubatch = context_params.n_batch; // the batch queue is managed in the JS side, so there's no need for managing it on the C++ side
-        }
+            samplers.reserve(samplersArray.Length());
+            for (uint32_t i = 0; i < samplersArray.Length(); i++) {
+                AddonSampler* sampler = Napi::ObjectWrap<AddonSampler>::Unwrap(samplersArray.Get(i).As<Napi::Object>());
 
-        if (options.Has("sequences")) {
-            context_params.n_seq_max = options.Get("sequences").As<Napi::Number>().Uint32Value();
-        }
+                // each sampler owns its candidates buffer exclusively during the parallel
+                // sampling below, so the same sampler cannot back multiple logit indexes
+                if (!hasDuplicateSamplers && std::find(samplers.begin(), samplers.end(), sampler) != samplers.end()) {
+                    hasDuplicateSamplers = true;
+                }
 
-        if (options.Has("embeddings")) {
-            context_params.embeddings = options.Get("embeddings").As<Napi::Boolean>().Value();
+                sampler->Ref();
+                samplers.push_back(sampler);
+            }
+
+            results.resize(logitIndexes.size(), -1);
         }
+        ~AddonContextSampleTokensWorker() {
+            ctx->Unref();
 
-        if (options.Has("ranking") && options.Get("ranking").As<Napi::Boolean>().Value()) {
-            context_params.pooling_type = LLAMA_POOLING_TYPE_RANK;
+            for (auto* sampler : samplers) {
+                sampler->Unref();
+            }
         }
 
-        if (options.Has("flashAttention")) {
-            bool flashAttention = options.Get("flashAttention").As<Napi::Boolean>().Value();
-            context_params.flash_attn_type = flashAttention ? LLAMA_FLASH_ATTN_TYPE_ENABLED : LLAMA_FLASH_ATTN_TYPE_DISABLED;
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
         }
 
-        if (options.Has("threads")) {
-            const auto n_threads = options.Get("threads").As<Napi::Number>().Int32Value();
-            const auto resolved_n_threads = n_threads == 0 ? std::max((int32_t)std::thread::hardware_concurrency(), context_params.n_threads) : n_threads;
+    protected:
+        Napi::Promise::Deferred deferred;
+        bool hasDuplicateSamplers = false;
 
-            context_params.n_threads = resolved_n_threads;
-            context_params.n_threads_batch = resolved_n_threads;
-        }
+        void Execute() {
+            try {
+                if (samplers.size() != logitIndexes.size()) {
+                    SetError("A sampler must be provided for every logit index");
+                    return;
+                }
 
-        if (options.Has("performanceTracking")) {
-            context_params.no_perf = !(options.Get("performanceTracking").As<Napi::Boolean>().Value());
-        }
+                if (hasDuplicateSamplers) {
+                    SetError("The same sampler cannot be used for multiple logit indexes");
+                    return;
+                }
 
-        if (options.Has("swaFullCache")) {
-            context_params.swa_full = options.Get("swaFullCache").As<Napi::Boolean>().Value();
-        }
-    }
-}
-AddonContext::~AddonContext() {
-    dispose();
-}
+                if (llama_get_logits(ctx->ctx) == nullptr) {
+                    SetError("This model does not support token generation");
+                    return;
+                }
 
-void AddonContext::dispose() {
-    if (disposed) {
-        return;
-    }
+                for (auto* sampler : samplers) {
+                    sampler->rebuildChainIfNeeded();
+                }
 
-    disposed = true;
-    if (contextLoaded) {
-        contextLoaded = false;
-        llama_free(ctx);
+                // each sampler has its own candidates buffer, so the per-sequence
+                // candidate construction and sampler application can run in parallel
+                const size_t sequences = logitIndexes.size();
+                const size_t threadCount = std::min(
+                    sequences,
+                    static_cast<size_t>(std::max((int32_t)std::thread::hardware_concurrency(), 1))
+                );
+
+                if (threadCount <= 1) {
+                    for (size_t i = 0; i < sequences; i++) {
+                        results[i] = sampleSequence(i);
+                    }
+                    return;
+                }
 
-        adjustNapiExternalMemorySubtract(Env(), loadedContextMemorySize);
-        loadedContextMemorySize = 0;
-    }
+                // an exception escaping a std::thread terminates the process, so each
+                // thread catches its own errors and the first one is surfaced after the joins
+                std::vector<std::string> threadErrors(threadCount);
+                std::vector<std::thread> threads;
+                threads.reserve(threadCount);
+                for (size_t t = 0; t < threadCount; t++) {
+                    threads.emplace_back([this, t, threadCount, sequences, &threadErrors]() {
+                        try {
+                            for (size_t i = t; i < sequences; i += threadCount) {
+                                results[i] = sampleSequence(i);
+                            }
+                        } catch (const std::exception& e) {
+                            threadErrors[t] = e.what();
+                        } catch(...) {
+                            threadErrors[t] = "Unknown error when calling \"sampleTokens\"";
+                        }
+                    });
+                }
 
-    model->Unref();
+                for (auto & thread : threads) {
+                    thread.join();
+                }
 
-    disposeBatch();
-}
-void AddonContext::disposeBatch() {
-    if (!has_batch) {
-        return;
-    }
+                for (const auto & threadError : threadErrors) {
+                    if (!threadError.empty()) {
+                        SetError(threadError);
+                        return;
+                    }
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"sampleTokens\"");
+            }
+        }
 
-    llama_batch_free(batch);
-    has_batch = false;
-    batch_n_tokens = 0;
+        llama_token sampleSequence(size_t index) {
+            auto* sampler = samplers[index];
+            const auto * logits = llama_get_logits_ith(ctx->ctx, logitIndexes[index]);
+            const int n_vocab = llama_vocab_n_tokens(ctx->model->vocab);
 
-    adjustNapiExternalMemorySubtract(Env(), batchMemorySize);
-    batchMemorySize = 0;
-}
+            auto & candidates = sampler->tokenCandidates;
+            for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+                candidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+            }
 
-Napi::Value AddonContext::Init(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
+            llama_token_data_array cur_p = {
+                /* .data       = */ candidates.data(),
+                /* .size       = */ candidates.size(),
+                /* .selected   = */ -1,
+                /* .sorted     = */ false,
+            };
 
-    AddonContextLoadContextWorker* worker = new AddonContextLoadContextWorker(this->Env(), this);
-    worker->Queue();
-    return worker->GetPromise();
-}
-Napi::Value AddonContext::Dispose(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        return info.Env().Undefined();
-    }
+            llama_sampler_apply(sampler->chain, &cur_p);
 
-    if (contextLoaded) {
-        contextLoaded = false;
+            if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
+                return -1;
+            }
 
-        AddonContextUnloadContextWorker* worker = new AddonContextUnloadContextWorker(this->Env(), this);
-        worker->Queue();
-        return worker->GetPromise();
-    } else {
-        dispose();
+            const auto new_token_id = cur_p.data[cur_p.selected].id;
+            sampler->acceptToken(new_token_id);
+            return new_token_id;
+        }
 
-        Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
-        deferred.Resolve(info.Env().Undefined());
-        return deferred.Promise();
-    }
-}
+        void OnOK() {
+            Napi::Int32Array result = Napi::Int32Array::New(Env(), results.size());
+            for (size_t i = 0; i < results.size(); i++) {
+                result[i] = results[i];
+            }
 
-Napi::Value AddonContext::GetContextSize(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
 
-    return Napi::Number::From(info.Env(), llama_n_ctx(ctx));
-}
-Napi::Value AddonContext::InitBatch(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
+class AddonContextDecodeAndSampleWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* ctx;
+        AddonSampler* sampler;
+        int32_t batchLogitIndex;
+        int32_t sequenceId = 0;
+        int32_t nextTokenContextIndex = 0;
+        uint32_t maxTokens = 1;
+        std::vector<llama_token> stopTokens;
+        std::vector<llama_token> sampledTokens;
+
+        AddonContextDecodeAndSampleWorker(const Napi::CallbackInfo& info, AddonContext* ctx)
+            : Napi::AsyncWorker(info.Env(), "AddonContextDecodeAndSampleWorker"),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            ctx->Ref();
 
-    if (has_batch) {
-        llama_batch_free(batch);
-    }
+            batchLogitIndex = info[0].As<Napi::Number>().Int32Value();
+            sampler = Napi::ObjectWrap<AddonSampler>::Unwrap(info[1].As<Napi::Object>());
+            sampler->Ref();
 
-    int32_t n_tokens = info[0].As<Napi::Number>().Int32Value();
+            if (info.Length() > 2 && info[2].IsObject()) {
+                Napi::Object options = info[2].As<Napi::Object>();
 
-    batch = llama_batch_init(n_tokens, 0, 1);
+                if (options.Has("sequenceId")) {
+                    sequenceId = options.Get("sequenceId").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("nextTokenContextIndex")) {
+                    nextTokenContextIndex = options.Get("nextTokenContextIndex").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("maxTokens")) {
+                    maxTokens = options.Get("maxTokens").As<Napi::Number>().Uint32Value();
+                }
+
+                if (options.Has("stopTokens")) {
+                    Napi::Uint32Array stopTokensArray = options.Get("stopTokens").As<Napi::Uint32Array>();
+                    stopTokens.reserve(stopTokensArray.ElementLength());
+                    for (size_t i = 0; i < stopTokensArray.ElementLength(); i++) {
+                        stopTokens.push_back(static_cast<llama_token>(stopTokensArray[i]));
+                    }
+                }
+            }
+
+            sampledTokens.reserve(maxTokens);
+        }
+        ~AddonContextDecodeAndSampleWorker() {
+            ctx->Unref();
+            sampler->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                // decode the batch that was already filled on the JS side,
+                // then keep sampling and decoding natively until a stop condition is met,
+                // to avoid a thread pool round trip for every generated token
+                int32_t logitIndex = batchLogitIndex;
+
+                while (true) {
+                    const auto decodeError = decodeBatchSync(ctx);
+
+                    if (!decodeError.empty()) {
+                        SetError(decodeError);
+                        return;
+                    }
+
+                    const auto token = sampleToken(logitIndex);
+                    if (token < 0) {
+                        return;
+                    }
+
+                    sampledTokens.push_back(token);
+
+                    if (sampledTokens.size() >= maxTokens || isStopToken(token)) {
+                        return;
+                    }
+
+                    common_batch_clear(ctx->batch);
+                    common_batch_add(ctx->batch, token, nextTokenContextIndex, { sequenceId }, true);
+                    nextTokenContextIndex++;
+                    logitIndex = 0;
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"decodeAndSample\"");
+            }
+        }
+
+        bool isStopToken(llama_token token) {
+            if (llama_vocab_is_eog(ctx->model->vocab, token)) {
+                return true;
+            }
+
+            return std::find(stopTokens.begin(), stopTokens.end(), token) != stopTokens.end();
+        }
+
+        llama_token sampleToken(int32_t logitIndex) {
+            if (llama_get_logits(ctx->ctx) == nullptr) {
+                SetError("This model does not support token generation");
+                return -1;
+            }
+
+            sampler->rebuildChainIfNeeded();
+
+            const auto * logits = llama_get_logits_ith(ctx->ctx, logitIndex);
+            const int n_vocab = llama_vocab_n_tokens(ctx->model->vocab);
+
+            auto & candidates = sampler->tokenCandidates;
+            for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+                candidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+            }
+
+            llama_token_data_array cur_p = {
+                /* .data       = */ candidates.data(),
+                /* .size       = */ candidates.size(),
+                /* .selected   = */ -1,
+                /* .sorted     = */ false,
+            };
+
+            llama_sampler_apply(sampler->chain, &cur_p);
+
+            if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
+                return -1;
+            }
+
+            const auto new_token_id = cur_p.data[cur_p.selected].id;
+            sampler->acceptToken(new_token_id);
+            return new_token_id;
+        }
+
+        void OnOK() {
+            Napi::Uint32Array result = Napi::Uint32Array::New(Env(), sampledTokens.size());
+            for (size_t i = 0; i < sampledTokens.size(); i++) {
+                result[i] = static_cast<uint32_t>(sampledTokens[i]);
+            }
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+// the number of trailing bytes that must be held back from emission so that
+// no stop string match or incomplete UTF-8 sequence is ever split across emitted chunks
+static size_t calculateTextHoldbackSize(const std::string & text, const std::vector<std::string> & stopStrings) {
+    size_t holdback = 0;
+
+    for (const auto & stopString : stopStrings) {
+        if (stopString.empty()) {
+            continue;
+        }
+
+        const size_t maxOverlap = std::min(text.size(), stopString.size() - 1);
+        for (size_t overlap = maxOverlap; overlap > holdback; overlap--) {
+            if (text.compare(text.size() - overlap, overlap, stopString, 0, overlap) == 0) {
+                holdback = overlap;
+                break;
+            }
+        }
+    }
+
+    // never emit a trailing incomplete UTF-8 sequence
+    size_t emitEnd = text.size() - holdback;
+    size_t continuationBytes = 0;
+    while (emitEnd > 0 && (static_cast<unsigned char>(text[emitEnd - 1]) & 0xC0) == 0x80) {
+        emitEnd--;
+        continuationBytes++;
+    }
+
+    if (emitEnd > 0) {
+        const unsigned char leadByte = static_cast<unsigned char>(text[emitEnd - 1]);
+        size_t sequenceLength = 1;
+        if ((leadByte & 0xF8) == 0xF0) {
+            sequenceLength = 4;
+        } else if ((leadByte & 0xF0) == 0xE0) {
+            sequenceLength = 3;
+        } else if ((leadByte & 0xE0) == 0xC0) {
+            sequenceLength = 2;
+        }
+
+        if (sequenceLength > 1 && continuationBytes < sequenceLength - 1) {
+            // the last lead byte starts a sequence that isn't complete yet
+            holdback = text.size() - (emitEnd - 1);
+        }
+    }
+
+    return holdback;
+}
+
+class AddonContextGenerateWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* ctx;
+        AddonSampler* sampler;
+        int32_t batchLogitIndex;
+        int32_t sequenceId = 0;
+        int32_t nextTokenContextIndex = 0;
+        uint32_t maxTokens = 1;
+        std::vector<llama_token> stopTokens;
+        std::vector<std::string> stopStrings;
+        std::vector<llama_token> generatedTokens;
+        std::string pendingText;
+        std::string stopReason = "maxTokens";
+        Napi::ThreadSafeFunction textChunkCallback;
+        bool hasTextChunkCallback = false;
+
+        AddonContextGenerateWorker(const Napi::CallbackInfo& info, AddonContext* ctx)
+            : Napi::AsyncWorker(info.Env(), "AddonContextGenerateWorker"),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            ctx->Ref();
+
+            batchLogitIndex = info[0].As<Napi::Number>().Int32Value();
+            sampler = Napi::ObjectWrap<AddonSampler>::Unwrap(info[1].As<Napi::Object>());
+            sampler->Ref();
+
+            if (info.Length() > 2 && info[2].IsObject()) {
+                Napi::Object options = info[2].As<Napi::Object>();
+
+                if (options.Has("sequenceId")) {
+                    sequenceId = options.Get("sequenceId").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("nextTokenContextIndex")) {
+                    nextTokenContextIndex = options.Get("nextTokenContextIndex").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("maxTokens")) {
+                    maxTokens = options.Get("maxTokens").As<Napi::Number>().Uint32Value();
+                }
+
+                if (options.Has("stopTokens")) {
+                    Napi::Uint32Array stopTokensArray = options.Get("stopTokens").As<Napi::Uint32Array>();
+                    stopTokens.reserve(stopTokensArray.ElementLength());
+                    for (size_t i = 0; i < stopTokensArray.ElementLength(); i++) {
+                        stopTokens.push_back(static_cast<llama_token>(stopTokensArray[i]));
+                    }
+                }
+
+                if (options.Has("stopStrings")) {
+                    Napi::Array stopStringsArray = options.Get("stopStrings").As<Napi::Array>();
+                    stopStrings.reserve(stopStringsArray.Length());
+                    for (uint32_t i = 0; i < stopStringsArray.Length(); i++) {
+                        stopStrings.push_back(stopStringsArray.Get(i).As<Napi::String>().Utf8Value());
+                    }
+                }
+            }
+
+            if (info.Length() > 3 && info[3].IsFunction()) {
+                textChunkCallback = Napi::ThreadSafeFunction::New(
+                    info.Env(),
+                    info[3].As<Napi::Function>(),
+                    "AddonContextGenerateTextChunkCallback",
+                    0,
+                    1
+                );
+                hasTextChunkCallback = true;
+            }
+
+            generatedTokens.reserve(maxTokens);
+        }
+        ~AddonContextGenerateWorker() {
+            ctx->Unref();
+            sampler->Unref();
+
+            if (hasTextChunkCallback) {
+                textChunkCallback.Release();
+            }
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                // run the decode->sample->accept loop entirely natively,
+                // detokenizing incrementally for stop-string matching and
+                // streaming completed text chunks back through the callback
+                int32_t logitIndex = batchLogitIndex;
+
+                while (true) {
+                    const auto decodeError = decodeBatchSync(ctx);
+                    if (!decodeError.empty()) {
+                        SetError(decodeError);
+                        return;
+                    }
+
+                    const auto token = sampleToken(logitIndex);
+                    if (token < 0) {
+                        stopReason = "noToken";
+                        break;
+                    }
+
+                    generatedTokens.push_back(token);
+
+                    if (llama_vocab_is_eog(ctx->model->vocab, token)) {
+                        stopReason = "eogToken";
+                        break;
+                    }
+
+                    if (std::find(stopTokens.begin(), stopTokens.end(), token) != stopTokens.end()) {
+                        stopReason = "stopToken";
+                        break;
+                    }
+
+                    pendingText += common_token_to_piece(ctx->ctx, token, false);
+
+                    if (matchesStopString()) {
+                        stopReason = "stopString";
+                        break;
+                    }
+
+                    emitPendingText(false);
+
+                    if (generatedTokens.size() >= maxTokens) {
+                        stopReason = "maxTokens";
+                        break;
+                    }
+
+                    common_batch_clear(ctx->batch);
+                    common_batch_add(ctx->batch, token, nextTokenContextIndex, { sequenceId }, true);
+                    nextTokenContextIndex++;
+                    logitIndex = 0;
+                }
+
+                emitPendingText(true);
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"generate\"");
+            }
+        }
+
+        bool matchesStopString() {
+            for (const auto & stopString : stopStrings) {
+                const auto matchIndex = pendingText.find(stopString);
+                if (matchIndex != std::string::npos) {
+                    // text past the stop string is never emitted
+                    pendingText.resize(matchIndex);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void emitPendingText(bool flush) {
+            if (!hasTextChunkCallback || pendingText.empty()) {
+                return;
+            }
+
+            const size_t holdback = flush ? 0 : calculateTextHoldbackSize(pendingText, stopStrings);
+            if (pendingText.size() <= holdback) {
+                return;
+            }
+
+            auto* chunk = new std::string(pendingText.substr(0, pendingText.size() - holdback));
+            pendingText.erase(0, chunk->size());
+
+            const auto status = textChunkCallback.NonBlockingCall(
+                chunk,
+                [](Napi::Env env, Napi::Function jsCallback, std::string* data) {
+                    jsCallback.Call({Napi::String::New(env, *data)});
+                    delete data;
+                }
+            );
+
+            if (status != napi_ok) {
+                delete chunk;
+            }
+        }
+
+        llama_token sampleToken(int32_t logitIndex) {
+            if (llama_get_logits(ctx->ctx) == nullptr) {
+                SetError("This model does not support token generation");
+                return -1;
+            }
+
+            sampler->rebuildChainIfNeeded();
+
+            const auto * logits = llama_get_logits_ith(ctx->ctx, logitIndex);
+            const int n_vocab = llama_vocab_n_tokens(ctx->model->vocab);
+
+            auto & candidates = sampler->tokenCandidates;
+            for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+                candidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+            }
+
+            llama_token_data_array cur_p = {
+                /* .data       = */ candidates.data(),
+                /* .size       = */ candidates.size(),
+                /* .selected   = */ -1,
+                /* .sorted     = */ false,
+            };
+
+            llama_sampler_apply(sampler->chain, &cur_p);
+
+            if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
+                return -1;
+            }
+
+            const auto new_token_id = cur_p.data[cur_p.selected].id;
+            sampler->acceptToken(new_token_id);
+            return new_token_id;
+        }
+
+        void OnOK() {
+            Napi::Uint32Array tokens = Napi::Uint32Array::New(Env(), generatedTokens.size());
+            for (size_t i = 0; i < generatedTokens.size(); i++) {
+                tokens[i] = static_cast<uint32_t>(generatedTokens[i]);
+            }
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("tokens", tokens);
+            result.Set("stopReason", Napi::String::New(Env(), stopReason));
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+class AddonContextSpeculativeDecodeWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* ctx;
+        AddonContext* draftCtx;
+        AddonSampler* sampler;
+        int32_t batchLogitIndex;
+        int32_t sequenceId = 0;
+        int32_t draftSequenceId = 0;
+        int32_t nextTokenContextIndex = 0;
+        uint32_t maxTokens = 1;
+        uint32_t draftLength = 8;
+        std::vector<llama_token> stopTokens;
+        std::vector<llama_token> generatedTokens;
+        uint32_t draftedTokenCount = 0;
+        uint32_t acceptedDraftTokenCount = 0;
+        std::string stopReason = "maxTokens";
+
+        AddonContextSpeculativeDecodeWorker(const Napi::CallbackInfo& info, AddonContext* ctx)
+            : Napi::AsyncWorker(info.Env(), "AddonContextSpeculativeDecodeWorker"),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            ctx->Ref();
+
+            batchLogitIndex = info[0].As<Napi::Number>().Int32Value();
+            draftCtx = Napi::ObjectWrap<AddonContext>::Unwrap(info[1].As<Napi::Object>());
+            draftCtx->Ref();
+            sampler = Napi::ObjectWrap<AddonSampler>::Unwrap(info[2].As<Napi::Object>());
+            sampler->Ref();
+
+            if (info.Length() > 3 && info[3].IsObject()) {
+                Napi::Object options = info[3].As<Napi::Object>();
+
+                if (options.Has("sequenceId")) {
+                    sequenceId = options.Get("sequenceId").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("draftSequenceId")) {
+                    draftSequenceId = options.Get("draftSequenceId").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("nextTokenContextIndex")) {
+                    nextTokenContextIndex = options.Get("nextTokenContextIndex").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("maxTokens")) {
+                    maxTokens = options.Get("maxTokens").As<Napi::Number>().Uint32Value();
+                }
+
+                if (options.Has("draftLength")) {
+                    draftLength = options.Get("draftLength").As<Napi::Number>().Uint32Value();
+                }
+
+                if (options.Has("stopTokens")) {
+                    Napi::Uint32Array stopTokensArray = options.Get("stopTokens").As<Napi::Uint32Array>();
+                    stopTokens.reserve(stopTokensArray.ElementLength());
+                    for (size_t i = 0; i < stopTokensArray.ElementLength(); i++) {
+                        stopTokens.push_back(static_cast<llama_token>(stopTokensArray[i]));
+                    }
+                }
+            }
+
+            generatedTokens.reserve(maxTokens);
+        }
+        ~AddonContextSpeculativeDecodeWorker() {
+            ctx->Unref();
+            draftCtx->Unref();
+            sampler->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            // both contexts get local batches, so the context batches
+            // (filled and sized on the JS side) are left untouched
+            llama_batch draftBatch = llama_batch_init(1, 0, 1);
+            llama_batch verifyBatch = llama_batch_init(draftLength + 1, 0, 1);
+
+            try {
+                ExecuteLoop(draftBatch, verifyBatch);
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"speculativeDecode\"");
+            }
+
+            llama_batch_free(draftBatch);
+            llama_batch_free(verifyBatch);
+        }
+
+        void ExecuteLoop(llama_batch& draftBatch, llama_batch& verifyBatch) {
+            // the draft-generate -> target-verify -> accept/rollback loop runs
+            // entirely within this worker execution, so the per-token cost is
+            // free of JS round trips on either context.
+            // the target batch was already filled on the JS side; decode it and
+            // sample the first confirmed token
+            auto decodeError = decodeBatchSync(ctx);
+            if (!decodeError.empty()) {
+                SetError(decodeError);
+                return;
+            }
+
+            llama_token cur = sampleToken(batchLogitIndex);
+            if (cur < 0) {
+                stopReason = "noToken";
+                return;
+            }
+
+            generatedTokens.push_back(cur);
+            if (checkStopToken(cur) || generatedTokens.size() >= maxTokens) {
+                return;
+            }
+
+            // the context index of "cur"; the draft context is expected to have
+            // the same token history evaluated up to this index
+            llama_pos pos = nextTokenContextIndex;
+            std::vector<llama_token> draftTokens;
+            draftTokens.reserve(draftLength);
+
+            while (generatedTokens.size() < maxTokens) {
+                const int32_t draftCount = std::min(
+                    static_cast<int32_t>(draftLength),
+                    static_cast<int32_t>(maxTokens - generatedTokens.size()) - 1
+                );
+
+                // draft phase: greedily generate candidate tokens on the draft context
+                draftTokens.clear();
+                llama_token draftFeed = cur;
+                llama_pos draftPos = pos;
+                for (int32_t i = 0; i < draftCount; i++) {
+                    common_batch_clear(draftBatch);
+                    common_batch_add(draftBatch, draftFeed, draftPos, { draftSequenceId }, true);
+
+                    decodeError = decodeBatchSync(draftCtx, draftBatch);
+                    if (!decodeError.empty()) {
+                        SetError(decodeError);
+                        return;
+                    }
+
+                    const auto draftToken = sampleDraftTokenGreedy();
+                    if (draftToken < 0) {
+                        break;
+                    }
+
+                    draftTokens.push_back(draftToken);
+                    draftFeed = draftToken;
+                    draftPos++;
+                }
+
+                // decode the last pending token on the draft context as well,
+                // so its KV cache stays contiguous when every draft token is accepted
+                common_batch_clear(draftBatch);
+                common_batch_add(draftBatch, draftFeed, draftPos, { draftSequenceId }, false);
+                decodeError = decodeBatchSync(draftCtx, draftBatch);
+                if (!decodeError.empty()) {
+                    SetError(decodeError);
+                    return;
+                }
+
+                const int32_t actualDraftCount = static_cast<int32_t>(draftTokens.size());
+                draftedTokenCount += actualDraftCount;
+
+                // verify phase: decode "cur" and all draft tokens on the target
+                // context in one batch, with logits for every position
+                common_batch_clear(verifyBatch);
+                common_batch_add(verifyBatch, cur, pos, { sequenceId }, true);
+                for (int32_t i = 0; i < actualDraftCount; i++) {
+                    common_batch_add(verifyBatch, draftTokens[i], pos + i + 1, { sequenceId }, true);
+                }
+
+                decodeError = decodeBatchSync(ctx, verifyBatch);
+                if (!decodeError.empty()) {
+                    SetError(decodeError);
+                    return;
+                }
+
+                // accept draft tokens while the target sampler agrees with them;
+                // the first disagreement yields the target's own next token
+                llama_token nextCur = -1;
+                int32_t acceptedCount = 0;
+                bool stopped = false;
+
+                for (int32_t i = 0; i <= actualDraftCount; i++) {
+                    const auto token = sampleToken(i);
+                    if (token < 0) {
+                        stopReason = "noToken";
+                        stopped = true;
+                        break;
+                    }
+
+                    if (i < actualDraftCount && token == draftTokens[i]) {
+                        generatedTokens.push_back(token);
+                        acceptedDraftTokenCount++;
+                        acceptedCount++;
+
+                        if (checkStopToken(token)) {
+                            stopped = true;
+                            break;
+                        }
+
+                        if (generatedTokens.size() >= maxTokens) {
+                            stopReason = "maxTokens";
+                            stopped = true;
+                            break;
+                        }
+                    } else {
+                        nextCur = token;
+                        break;
+                    }
+                }
+
+                // drop the speculative KV cells past the last confirmed position on both contexts
+                const llama_pos confirmedEnd = pos + acceptedCount + 1;
+                llama_memory_seq_rm(llama_get_memory(ctx->ctx), sequenceId, confirmedEnd, -1);
+                llama_memory_seq_rm(llama_get_memory(draftCtx->ctx), draftSequenceId, confirmedEnd, -1);
+
+                if (stopped) {
+                    return;
+                }
+
+                if (nextCur < 0) {
+                    stopReason = "noToken";
+                    return;
+                }
+
+                generatedTokens.push_back(nextCur);
+                if (checkStopToken(nextCur)) {
+                    return;
+                }
+
+                cur = nextCur;
+                pos = confirmedEnd;
+            }
+
+            stopReason = "maxTokens";
+        }
+
+        bool checkStopToken(llama_token token) {
+            if (llama_vocab_is_eog(ctx->model->vocab, token)) {
+                stopReason = "eogToken";
+                return true;
+            }
+
+            if (std::find(stopTokens.begin(), stopTokens.end(), token) != stopTokens.end()) {
+                stopReason = "stopToken";
+                return true;
+            }
+
+            return false;
+        }
+
+        llama_token sampleDraftTokenGreedy() {
+            const auto * logits = llama_get_logits_ith(draftCtx->ctx, 0);
+            if (logits == nullptr) {
+                return -1;
+            }
+
+            const int n_vocab = llama_vocab_n_tokens(draftCtx->model->vocab);
+            llama_token bestToken = 0;
+            float bestLogit = logits[0];
+            for (llama_token token_id = 1; token_id < n_vocab; token_id++) {
+                if (logits[token_id] > bestLogit) {
+                    bestLogit = logits[token_id];
+                    bestToken = token_id;
+                }
+            }
+
+            return bestToken;
+        }
+
+        llama_token sampleToken(int32_t logitIndex) {
+            if (llama_get_logits(ctx->ctx) == nullptr) {
+                SetError("This model does not support token generation");
+                return -1;
+            }
+
+            sampler->rebuildChainIfNeeded();
+
+            const auto * logits = llama_get_logits_ith(ctx->ctx, logitIndex);
+            const int n_vocab = llama_vocab_n_tokens(ctx->model->vocab);
+
+            auto & candidates = sampler->tokenCandidates;
+            for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+                candidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+            }
+
+            llama_token_data_array cur_p = {
+                /* .data       = */ candidates.data(),
+                /* .size       = */ candidates.size(),
+                /* .selected   = */ -1,
+                /* .sorted     = */ false,
+            };
+
+            llama_sampler_apply(sampler->chain, &cur_p);
+
+            if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
+                return -1;
+            }
+
+            const auto new_token_id = cur_p.data[cur_p.selected].id;
+            sampler->acceptToken(new_token_id);
+            return new_token_id;
+        }
+
+        void OnOK() {
+            Napi::Uint32Array tokens = Napi::Uint32Array::New(Env(), generatedTokens.size());
+            for (size_t i = 0; i < generatedTokens.size(); i++) {
+                tokens[i] = static_cast<uint32_t>(generatedTokens[i]);
+            }
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("tokens", tokens);
+            result.Set("stopReason", Napi::String::New(Env(), stopReason));
+            result.Set("draftedTokenCount", Napi::Number::New(Env(), draftedTokenCount));
+            result.Set("acceptedDraftTokenCount", Napi::Number::New(Env(), acceptedDraftTokenCount));
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonContext>(info) {
+    model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
+    model->Ref();
+
+    context_params = llama_context_default_params();
+    context_params.n_ctx = 4096;
+    context_params.n_threads = std::max(cpu_get_num_math(), 1);
+    context_params.n_threads_batch = context_params.n_threads;
+    context_params.no_perf = true;
+    context_params.swa_full = false;
+
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+
+        if (options.Has("contextSize")) {
+            context_params.n_ctx = options.Get("contextSize").As<Napi::Number>().Uint32Value();
+        }
+
+        if (options.Has("batchSize")) {
+            context_params.n_batch = options.Get("batchSize").As<Napi::Number>().Uint32Value();
+            context_params.n_ubatch = context_params.n_batch; // the batch queue is managed in the JS side, so there's no need for managing it on the C++ side
+        }
+
+        if (options.Has("sequences")) {
+            context_params.n_seq_max = options.Get("sequences").As<Napi::Number>().Uint32Value();
+        }
+
+        if (options.Has("embeddings")) {
+            context_params.embeddings = options.Get("embeddings").As<Napi::Boolean>().Value();
+        }
+
+        if (options.Has("ranking") && options.Get("ranking").As<Napi::Boolean>().Value()) {
+            context_params.pooling_type = LLAMA_POOLING_TYPE_RANK;
+        }
+
+        if (options.Has("flashAttention")) {
+            bool flashAttention = options.Get("flashAttention").As<Napi::Boolean>().Value();
+            context_params.flash_attn_type = flashAttention ? LLAMA_FLASH_ATTN_TYPE_ENABLED : LLAMA_FLASH_ATTN_TYPE_DISABLED;
+        }
+
+        if (options.Has("threads")) {
+            const auto n_threads = options.Get("threads").As<Napi::Number>().Int32Value();
+            const auto resolved_n_threads = n_threads == 0 ? std::max((int32_t)std::thread::hardware_concurrency(), context_params.n_threads) : n_threads;
+
+            context_params.n_threads = resolved_n_threads;
+            context_params.n_threads_batch = resolved_n_threads;
+        }
+
+        if (options.Has("performanceTracking")) {
+            context_params.no_perf = !(options.Get("performanceTracking").As<Napi::Boolean>().Value());
+        }
+
+        if (options.Has("swaFullCache")) {
+            context_params.swa_full = options.Get("swaFullCache").As<Napi::Boolean>().Value();
+        }
+
+        if (options.Has("dedicatedInferenceThread") && options.Get("dedicatedInferenceThread").As<Napi::Boolean>().Value()) {
+            inferenceThread = new InferenceThread(info.Env());
+        }
+
+        if (options.Has("pooled")) {
+            poolable = options.Get("pooled").As<Napi::Boolean>().Value();
+        }
+    }
+
+    // a pooled context can only replace a new one when every param that affects
+    // its allocations matches; the thread config is excluded since it's re-applied on checkout
+    uint64_t hash = 14695981039346656037ULL;
+    const auto hashValue = [&hash](uint64_t value) {
+        for (size_t i = 0; i < sizeof(value); i++) {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    hashValue(static_cast<uint64_t>(context_params.n_ctx));
+    hashValue(static_cast<uint64_t>(context_params.n_batch));
+    hashValue(static_cast<uint64_t>(context_params.n_ubatch));
+    hashValue(static_cast<uint64_t>(context_params.n_seq_max));
+    hashValue(static_cast<uint64_t>(context_params.embeddings));
+    hashValue(static_cast<uint64_t>(static_cast<int64_t>(context_params.pooling_type)));
+    hashValue(static_cast<uint64_t>(static_cast<int64_t>(context_params.flash_attn_type)));
+    hashValue(static_cast<uint64_t>(context_params.no_perf));
+    hashValue(static_cast<uint64_t>(context_params.swa_full));
+    contextParamsHash = hash;
+}
+AddonContext::~AddonContext() {
+    dispose();
+}
+
+void AddonContext::dispose() {
+    if (disposed) {
+        return;
+    }
+
+    disposed = true;
+    if (inferenceThread != nullptr) {
+        inferenceThread->stop();
+        delete inferenceThread;
+        inferenceThread = nullptr;
+    }
+
+    detachThreadpools();
+
+    if (contextLoaded) {
+        contextLoaded = false;
+
+        bool pooled = false;
+        if (poolable && model->data != nullptr && !model->disposed) {
+            pooled = model->data->checkInContext(contextParamsHash, ctx);
+        }
+
+        if (!pooled) {
+            llama_free(ctx);
+        }
+
+        adjustNapiExternalMemorySubtract(Env(), loadedContextMemorySize);
+        loadedContextMemorySize = 0;
+    }
+
+    model->Unref();
+
+    disposeBatch();
+}
+// upper bucket bounds of the decode wall-time histogram, in microseconds;
+// the last bucket catches everything beyond them
+static const uint64_t decodeTimeHistogramBucketMaxUs[AddonContext::decodeTimeHistogramBucketCount] = {
+    1000, 2000, 5000, 10000, 25000, 50000, 100000, UINT64_MAX
+};
+
+void AddonContext::recordDecodeTime(uint64_t timeUs, int32_t batchTokens) {
+    decodeCallCount.fetch_add(1, std::memory_order_relaxed);
+    decodeTotalTimeUs.fetch_add(timeUs, std::memory_order_relaxed);
+    decodedTokenCount.fetch_add(static_cast<uint64_t>(std::max(batchTokens, 0)), std::memory_order_relaxed);
+    decodeBatchCapacityTokenCount.fetch_add(static_cast<uint64_t>(std::max(batch_allocated_tokens, 0)), std::memory_order_relaxed);
+
+    for (size_t i = 0; i < decodeTimeHistogramBucketCount; i++) {
+        if (timeUs <= decodeTimeHistogramBucketMaxUs[i]) {
+            decodeTimeHistogram[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+void AddonContext::recordSamplerTime(uint64_t timeUs) {
+    samplerCallCount.fetch_add(1, std::memory_order_relaxed);
+    samplerTotalTimeUs.fetch_add(timeUs, std::memory_order_relaxed);
+}
+void AddonContext::recordQueueWait(uint64_t timeUs) {
+    queueWaitCallCount.fetch_add(1, std::memory_order_relaxed);
+    queueWaitTotalTimeUs.fetch_add(timeUs, std::memory_order_relaxed);
+}
+
+void AddonContext::detachThreadpools() {
+    if (attachedThreadpool == nullptr && attachedBatchThreadpool == nullptr) {
+        return;
+    }
+
+    if (contextLoaded) {
+        llama_detach_threadpool(ctx);
+    }
+
+    if (attachedThreadpool != nullptr) {
+        attachedThreadpool->Unref();
+        attachedThreadpool = nullptr;
+    }
+
+    if (attachedBatchThreadpool != nullptr) {
+        attachedBatchThreadpool->Unref();
+        attachedBatchThreadpool = nullptr;
+    }
+}
+void AddonContext::disposeBatch() {
+    if (!has_batch) {
+        return;
+    }
+
+    llama_batch_free(batch);
+    has_batch = false;
+    batch_n_tokens = 0;
+    batch_allocated_tokens = 0;
+
+    adjustNapiExternalMemorySubtract(Env(), batchMemorySize);
+    batchMemorySize = 0;
+}
+
+void AddonContext::ensureBatchCapacity(int32_t n_tokens) {
+    // the batch is a grow-only arena: reuse the largest allocation made so far
+    // and only reallocate upward, so resizing the batch between decode cycles is free
+    if (has_batch && n_tokens <= batch_allocated_tokens) {
+        common_batch_clear(batch);
+        return;
+    }
+
+    if (has_batch) {
+        llama_batch_free(batch);
+    }
+
+    batch = llama_batch_init(n_tokens, 0, 1);
     has_batch = true;
+    batch_allocated_tokens = n_tokens;
+
+    uint64_t newBatchMemorySize = calculateBatchMemorySize(n_tokens, llama_model_n_embd(model->model), context_params.n_batch);
+    if (newBatchMemorySize > batchMemorySize) {
+        adjustNapiExternalMemoryAdd(Env(), newBatchMemorySize - batchMemorySize);
+        batchMemorySize = newBatchMemorySize;
+    } else if (newBatchMemorySize < batchMemorySize) {
+        adjustNapiExternalMemorySubtract(Env(), batchMemorySize - newBatchMemorySize);
+        batchMemorySize = newBatchMemorySize;
+    }
+}
+
+Napi::Value AddonContext::Init(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextLoadContextWorker* worker = new AddonContextLoadContextWorker(this->Env(), this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::Dispose(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        return info.Env().Undefined();
+    }
+
+    if (contextLoaded) {
+        detachThreadpools();
+        contextLoaded = false;
+
+        AddonContextUnloadContextWorker* worker = new AddonContextUnloadContextWorker(this->Env(), this);
+        worker->Queue();
+        return worker->GetPromise();
+    } else {
+        dispose();
+
+        Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+        deferred.Resolve(info.Env().Undefined());
+        return deferred.Promise();
+    }
+}
+
+Napi::Value AddonContext::GetContextSize(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), llama_n_ctx(ctx));
+}
+Napi::Value AddonContext::InitBatch(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t n_tokens = info[0].As<Napi::Number>().Int32Value();
+
+    ensureBatchCapacity(n_tokens);
     batch_n_tokens = n_tokens;
 
-    uint64_t newBatchMemorySize = calculateBatchMemorySize(n_tokens, llama_model_n_embd(model->model), context_params.n_batch);
-    if (newBatchMemorySize > batchMemorySize) {
-        adjustNapiExternalMemoryAdd(Env(), newBatchMemorySize - batchMemorySize);
-        batchMemorySize = newBatchMemorySize;
-    } else if (newBatchMemorySize < batchMemorySize) {
-        adjustNapiExternalMemorySubtract(Env(), batchMemorySize - newBatchMemorySize);
-        batchMemorySize = newBatchMemorySize;
+    return info.Env().Undefined();
+}
+Napi::Value AddonContext::ReserveBatch(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t maxTokens = info[0].As<Napi::Number>().Int32Value();
+
+    ensureBatchCapacity(maxTokens);
+    batch_n_tokens = std::max(batch_n_tokens, maxTokens);
+
+    return info.Env().Undefined();
+}
+Napi::Value AddonContext::ShrinkBatch(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    disposeBatch();
+
+    return info.Env().Undefined();
+}
+Napi::Value AddonContext::DisposeBatch(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    disposeBatch();
+
+    return info.Env().Undefined();
+}
+Napi::Value AddonContext::AddToBatch(const Napi::CallbackInfo& info) {
+    if (!has_batch) {
+        Napi::Error::New(info.Env(), "No batch is initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    int32_t firstTokenContextIndex = info[1].As<Napi::Number>().Int32Value();
+    Napi::Uint32Array tokens = info[2].As<Napi::Uint32Array>();
+    Napi::Uint32Array tokenLogitIndexes = info[3].As<Napi::Uint32Array>();
+
+    auto tokensLength = tokens.ElementLength();
+    auto tokenLogitIndexesLength = tokenLogitIndexes.ElementLength();
+    GGML_ASSERT(batch.n_tokens + tokensLength <= batch_n_tokens);
+
+    Napi::Uint32Array resLogitIndexes = Napi::Uint32Array::New(info.Env(), tokenLogitIndexesLength);
+
+    for (size_t i = 0, l = 0; i < tokensLength; i++) {
+        if (l < tokenLogitIndexesLength && l < tokenLogitIndexesLength && tokenLogitIndexes[l] == i) {
+            common_batch_add(batch, static_cast<llama_token>(tokens[i]), firstTokenContextIndex + i, { sequenceId }, true);
+            resLogitIndexes[l] = batch.n_tokens - 1;
+            l++;
+        } else {
+            common_batch_add(batch, static_cast<llama_token>(tokens[i]), firstTokenContextIndex + i, { sequenceId }, false);
+        }
+    }
+
+    return resLogitIndexes;
+}
+Napi::Value AddonContext::SetBatch(const Napi::CallbackInfo& info) {
+    if (!has_batch) {
+        Napi::Error::New(info.Env(), "No batch is initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // one flat buffer with a (seqId, firstPos, tokenCount, logitIndexCount, logitIndexes..., tokens...)
+    // record per sequence, so a multi-sequence batch is populated in a single boundary crossing
+    Napi::Uint32Array packed = info[0].As<Napi::Uint32Array>();
+    const size_t packedLength = packed.ElementLength();
+
+    common_batch_clear(batch);
+
+    size_t totalLogitIndexes = 0;
+    for (size_t pos = 0; pos + 4 <= packedLength;) {
+        const uint32_t tokenCount = packed[pos + 2];
+        const uint32_t logitIndexCount = packed[pos + 3];
+
+        totalLogitIndexes += logitIndexCount;
+        pos += 4 + logitIndexCount + tokenCount;
+    }
+
+    Napi::Uint32Array resLogitIndexes = Napi::Uint32Array::New(info.Env(), totalLogitIndexes);
+    size_t resLogitIndexesCount = 0;
+
+    for (size_t pos = 0; pos + 4 <= packedLength;) {
+        const int32_t sequenceId = static_cast<int32_t>(packed[pos]);
+        const int32_t firstTokenContextIndex = static_cast<int32_t>(packed[pos + 1]);
+        const uint32_t tokenCount = packed[pos + 2];
+        const uint32_t logitIndexCount = packed[pos + 3];
+        const size_t logitIndexesStart = pos + 4;
+        const size_t tokensStart = logitIndexesStart + logitIndexCount;
+
+        GGML_ASSERT(tokensStart + tokenCount <= packedLength);
+        GGML_ASSERT(batch.n_tokens + tokenCount <= batch_n_tokens);
+
+        for (uint32_t i = 0, l = 0; i < tokenCount; i++) {
+            if (l < logitIndexCount && packed[logitIndexesStart + l] == i) {
+                common_batch_add(batch, static_cast<llama_token>(packed[tokensStart + i]), firstTokenContextIndex + i, { sequenceId }, true);
+                resLogitIndexes[resLogitIndexesCount++] = batch.n_tokens - 1;
+                l++;
+            } else {
+                common_batch_add(batch, static_cast<llama_token>(packed[tokensStart + i]), firstTokenContextIndex + i, { sequenceId }, false);
+            }
+        }
+
+        pos = tokensStart + tokenCount;
+    }
+
+    return resLogitIndexes;
+}
+Napi::Value AddonContext::DisposeSequence(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+
+    bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, -1, -1);
+
+    if (!result) {
+        Napi::Error::New(info.Env(), "Failed to dispose sequence").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // a disposed sequence can't serve as a prefix source anymore
+    kvCachePrefixes.erase(
+        std::remove_if(
+            kvCachePrefixes.begin(), kvCachePrefixes.end(),
+            [sequenceId](const KvCachePrefixEntry& entry) {
+                return entry.sequenceId == sequenceId;
+            }
+        ),
+        kvCachePrefixes.end()
+    );
+
+    return info.Env().Undefined();
+}
+// drops registered prefixes whose source sequence had cells edited in the
+// registered range - forking from them afterwards would copy wrong KV state
+void AddonContext::invalidateKvCachePrefixes(int32_t sequenceId, int32_t startPos, int32_t endPos) {
+    kvCachePrefixes.erase(
+        std::remove_if(
+            kvCachePrefixes.begin(), kvCachePrefixes.end(),
+            [sequenceId, startPos, endPos](const KvCachePrefixEntry& entry) {
+                if (entry.sequenceId != sequenceId) {
+                    return false;
+                }
+
+                const llama_pos editStart = std::max(startPos, 0);
+                const llama_pos editEnd = endPos < 0 ? std::numeric_limits<llama_pos>::max() : endPos;
+
+                return editStart < (llama_pos)entry.tokenCount && editEnd > editStart;
+            }
+        ),
+        kvCachePrefixes.end()
+    );
+}
+Napi::Value AddonContext::RemoveTokenCellsFromSequence(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    int32_t startPos = info[1].As<Napi::Number>().Int32Value();
+    int32_t endPos = info[2].As<Napi::Number>().Int32Value();
+
+    bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, startPos, endPos);
+
+    if (result) {
+        invalidateKvCachePrefixes(sequenceId, startPos, endPos);
+    }
+
+    return Napi::Boolean::New(info.Env(), result);
+}
+Napi::Value AddonContext::ShiftSequenceTokenCells(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    int32_t startPos = info[1].As<Napi::Number>().Int32Value();
+    int32_t endPos = info[2].As<Napi::Number>().Int32Value();
+    int32_t shiftDelta = info[3].As<Napi::Number>().Int32Value();
+
+    llama_memory_seq_add(llama_get_memory(ctx), sequenceId, startPos, endPos, shiftDelta);
+
+    if (shiftDelta != 0) {
+        invalidateKvCachePrefixes(sequenceId, startPos, endPos);
+    }
+
+    return info.Env().Undefined();
+}
+Napi::Value AddonContext::CopySequenceKvCache(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t srcSequenceId = info[0].As<Napi::Number>().Int32Value();
+    int32_t dstSequenceId = info[1].As<Napi::Number>().Int32Value();
+    int32_t startPos = info[2].As<Napi::Number>().Int32Value();
+    int32_t endPos = info[3].As<Napi::Number>().Int32Value();
+
+    // sharing cells between sequence ids is a metadata operation in llama.cpp's
+    // unified KV cache - the destination references the same cells copy-on-write
+    llama_memory_seq_cp(llama_get_memory(ctx), srcSequenceId, dstSequenceId, startPos, endPos);
+
+    return info.Env().Undefined();
+}
+
+static uint64_t hashTokenPrefix(const uint32_t* tokens, size_t tokenCount) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < tokenCount; i++) {
+        hash ^= tokens[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+Napi::Value AddonContext::RegisterKvCachePrefix(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsTypedArray()) {
+        Napi::TypeError::New(info.Env(), "Expected a sequence ID and the prefix tokens").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    Napi::Uint32Array prefixTokens = info[1].As<Napi::Uint32Array>();
+
+    if (prefixTokens.ElementLength() == 0) {
+        Napi::Error::New(info.Env(), "Cannot register an empty prefix").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
     }
 
+    const uint64_t tokensHash = hashTokenPrefix(prefixTokens.Data(), prefixTokens.ElementLength());
+
+    for (auto& entry : kvCachePrefixes) {
+        if (entry.tokensHash == tokensHash && entry.tokenCount == prefixTokens.ElementLength()) {
+            entry.sequenceId = sequenceId;
+            return info.Env().Undefined();
+        }
+    }
+
+    kvCachePrefixes.push_back({tokensHash, prefixTokens.ElementLength(), sequenceId});
+
     return info.Env().Undefined();
 }
-Napi::Value AddonContext::DisposeBatch(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::ForkSequenceFromKvCachePrefix(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    disposeBatch();
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsTypedArray()) {
+        Napi::TypeError::New(info.Env(), "Expected a sequence ID and the prefix tokens").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
 
-    return info.Env().Undefined();
+    const int32_t dstSequenceId = info[0].As<Napi::Number>().Int32Value();
+    Napi::Uint32Array prefixTokens = info[1].As<Napi::Uint32Array>();
+    const uint64_t tokensHash = hashTokenPrefix(prefixTokens.Data(), prefixTokens.ElementLength());
+
+    for (const auto& entry : kvCachePrefixes) {
+        if (entry.tokensHash != tokensHash || entry.tokenCount != prefixTokens.ElementLength()) {
+            continue;
+        }
+
+        if (entry.sequenceId != dstSequenceId) {
+            llama_memory_seq_cp(llama_get_memory(ctx), entry.sequenceId, dstSequenceId, 0, (llama_pos)entry.tokenCount);
+        }
+
+        kvCachePrefixHitCount++;
+        return Napi::Number::From(info.Env(), entry.tokenCount);
+    }
+
+    kvCachePrefixMissCount++;
+    return Napi::Number::From(info.Env(), -1);
 }
-Napi::Value AddonContext::AddToBatch(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::GetKvCachePrefixStats(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("registeredCount", Napi::Number::From(info.Env(), kvCachePrefixes.size()));
+    result.Set("hitCount", Napi::Number::From(info.Env(), kvCachePrefixHitCount));
+    result.Set("missCount", Napi::Number::From(info.Env(), kvCachePrefixMissCount));
+
+    return result;
+}
+Napi::Value AddonContext::GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+
+
+    const auto minPosition = llama_memory_seq_pos_min(llama_get_memory(ctx), sequenceId);
+
+    return Napi::Number::New(info.Env(), minPosition);
+}
+Napi::Value AddonContext::GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+
+
+    const auto maxPosition = llama_memory_seq_pos_max(llama_get_memory(ctx), sequenceId);
+
+    return Napi::Number::New(info.Env(), maxPosition);
+}
+Napi::Value AddonContext::DecodeBatch(const Napi::CallbackInfo& info) {
+    if (inferenceThread != nullptr) {
+        auto deferred = std::make_shared<Napi::Promise::Deferred>(Napi::Promise::Deferred::New(info.Env()));
+        this->Ref();
+
+        inferenceThread->submit(new InferenceThreadTask {
+            [this]() {
+                return decodeBatchSync(this);
+            },
+            [this, deferred](Napi::Env env, const std::string & error) {
+                if (error.empty()) {
+                    deferred->Resolve(env.Undefined());
+                } else {
+                    deferred->Reject(Napi::Error::New(env, error).Value());
+                }
+
+                this->Unref();
+            }
+        });
+
+        return deferred->Promise();
+    }
+
+    AddonContextDecodeBatchWorker* worker = new AddonContextDecodeBatchWorker(info.Env(), this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::SampleToken(const Napi::CallbackInfo& info) {
+    AddonContextSampleTokenWorker* worker = new AddonContextSampleTokenWorker(info, this);
+    auto promise = worker->GetPromise();
+
+    if (inferenceThread != nullptr) {
+        // sampling is the other per-token operation, so when a dedicated inference
+        // thread exists, run it there as well instead of paying a libuv pool
+        // round trip for every sampled token
+        inferenceThread->submit(new InferenceThreadTask {
+            [worker]() {
+                return worker->RunSync();
+            },
+            [worker](Napi::Env env, const std::string & error) {
+                worker->CompleteSync(env, error);
+                delete worker;
+            }
+        });
+
+        return promise;
+    }
+
+    worker->Queue();
+    return promise;
+}
+Napi::Value AddonContext::SampleTokens(const Napi::CallbackInfo& info) {
+    AddonContextSampleTokensWorker* worker = new AddonContextSampleTokensWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::DecodeAndSample(const Napi::CallbackInfo& info) {
     if (!has_batch) {
         Napi::Error::New(info.Env(), "No batch is initialized").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
-    int32_t firstTokenContextIndex = info[1].As<Napi::Number>().Int32Value();
-    Napi::Uint32Array tokens = info[2].As<Napi::Uint32Array>();
-    Napi::Uint32Array tokenLogitIndexes = info[3].As<Napi::Uint32Array>();
+    AddonContextDecodeAndSampleWorker* worker = new AddonContextDecodeAndSampleWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::Generate(const Napi::CallbackInfo& info) {
+    if (!has_batch) {
+        Napi::Error::New(info.Env(), "No batch is initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
 
-    auto tokensLength = tokens.ElementLength();
-    auto tokenLogitIndexesLength = tokenLogitIndexes.ElementLength();
-    GGML_ASSERT(batch.n_tokens + tokensLength <= batch_n_tokens);
+    AddonContextGenerateWorker* worker = new AddonContextGenerateWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
 
-    Napi::Uint32Array resLogitIndexes = Napi::Uint32Array::New(info.Env(), tokenLogitIndexesLength);
+Napi::Value AddonContext::SpeculativeDecode(const Napi::CallbackInfo& info) {
+    if (!has_batch) {
+        Napi::Error::New(info.Env(), "No batch is initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
 
-    for (size_t i = 0, l = 0; i < tokensLength; i++) {
-        if (l < tokenLogitIndexesLength && l < tokenLogitIndexesLength && tokenLogitIndexes[l] == i) {
-            common_batch_add(batch, static_cast<llama_token>(tokens[i]), firstTokenContextIndex + i, { sequenceId }, true);
-            resLogitIndexes[l] = batch.n_tokens - 1;
-            l++;
-        } else {
-            common_batch_add(batch, static_cast<llama_token>(tokens[i]), firstTokenContextIndex + i, { sequenceId }, false);
+    AddonContextSpeculativeDecodeWorker* worker = new AddonContextSpeculativeDecodeWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonContext::GetEmbedding(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t inputTokensLength = info[0].As<Napi::Number>().Int32Value();
+    int32_t maxVectorSize = (info.Length() > 1 && info[1].IsNumber()) ? info[1].As<Napi::Number>().Int32Value() : 0;
+
+    if (inputTokensLength <= 0) {
+        Napi::Error::New(info.Env(), "Invalid input tokens length").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const int n_embd = llama_model_n_embd(model->model);
+    const enum llama_pooling_type pooling_type = llama_pooling_type(ctx);
+    const auto* embeddings = pooling_type == LLAMA_POOLING_TYPE_NONE ? NULL : llama_get_embeddings_seq(ctx, 0);
+    if (embeddings == NULL) {
+        embeddings = llama_get_embeddings_ith(ctx, inputTokensLength - 1);
+    }
+
+    if (embeddings == NULL) {
+        Napi::Error::New(info.Env(), std::string("Failed to get embeddings for token ") + std::to_string(inputTokensLength - 1)).ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    size_t resultSize = maxVectorSize == 0 ? n_embd : std::min(n_embd, maxVectorSize);
+
+    // llama.cpp produces float embeddings, so copy them in one memcpy instead of
+    // converting every element to a boxed double
+    Napi::Float32Array result = Napi::Float32Array::New(info.Env(), resultSize);
+    std::memcpy(result.Data(), embeddings, resultSize * sizeof(float));
+
+    return result;
+}
+
+Napi::Value AddonContext::GetEmbeddings(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (info.Length() < 1 || !info[0].IsArray()) {
+        Napi::TypeError::New(info.Env(), "Expected an array of sequence IDs").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Array sequenceIds = info[0].As<Napi::Array>();
+    const uint32_t sequenceCount = sequenceIds.Length();
+    int32_t maxVectorSize = (info.Length() > 1 && info[1].IsNumber()) ? info[1].As<Napi::Number>().Int32Value() : 0;
+
+    if (sequenceCount == 0) {
+        Napi::Error::New(info.Env(), "Expected at least one sequence ID").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const enum llama_pooling_type pooling_type = llama_pooling_type(ctx);
+    if (pooling_type == LLAMA_POOLING_TYPE_NONE) {
+        Napi::Error::New(info.Env(), "\"getEmbeddings\" requires a context with a pooling type").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const int n_embd = llama_model_n_embd(model->model);
+    const size_t stride = maxVectorSize == 0 ? n_embd : std::min(n_embd, maxVectorSize);
+
+    // gather every requested sequence into one contiguous native buffer:
+    // one memcpy per sequence and a single boundary crossing for the whole batch
+    float* packedEmbeddings = new float[(size_t)sequenceCount * stride];
+
+    for (uint32_t i = 0; i < sequenceCount; i++) {
+        const int32_t sequenceId = sequenceIds.Get(i).As<Napi::Number>().Int32Value();
+
+        const auto* embeddings = llama_get_embeddings_seq(ctx, sequenceId);
+        if (embeddings == NULL) {
+            delete[] packedEmbeddings;
+            Napi::Error::New(info.Env(), std::string("Failed to get embeddings for sequence ") + std::to_string(sequenceId)).ThrowAsJavaScriptException();
+            return info.Env().Undefined();
         }
+
+        std::memcpy(packedEmbeddings + (size_t)i * stride, embeddings, stride * sizeof(float));
     }
 
-    return resLogitIndexes;
+    auto arrayBuffer = Napi::ArrayBuffer::New(
+        info.Env(), packedEmbeddings, (size_t)sequenceCount * stride * sizeof(float),
+        [](Napi::Env env, void* data) {
+            delete[] static_cast<float*>(data);
+        }
+    );
+
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("embeddings", Napi::Float32Array::New(info.Env(), (size_t)sequenceCount * stride, arrayBuffer, 0));
+    result.Set("stride", Napi::Number::From(info.Env(), stride));
+    result.Set("sequenceCount", Napi::Number::From(info.Env(), sequenceCount));
+
+    return result;
 }
-Napi::Value AddonContext::DisposeSequence(const Napi::CallbackInfo& info) {
+
+Napi::Value AddonContext::GetStateSize(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    return Napi::Number::From(info.Env(), llama_state_get_size(ctx));
+}
 
-    bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, -1, -1);
+Napi::Value AddonContext::GetThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
 
-    if (!result) {
-        Napi::Error::New(info.Env(), "Failed to dispose sequence").ThrowAsJavaScriptException();
+    return Napi::Number::From(info.Env(), llama_n_threads(ctx));
+}
+
+Napi::Value AddonContext::SetThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
+    const auto threads = info[0].As<Napi::Number>().Int32Value();
+    const auto resolvedThreads = threads == 0
+        ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
+        : threads;
+
+    if (llama_n_threads(ctx) != resolvedThreads) {
+        llama_set_n_threads(ctx, resolvedThreads, resolvedThreads);
+    }
+
     return info.Env().Undefined();
 }
-Napi::Value AddonContext::RemoveTokenCellsFromSequence(const Napi::CallbackInfo& info) {
+
+Napi::Value AddonContext::AttachThreadpool(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
-    int32_t startPos = info[1].As<Napi::Number>().Int32Value();
-    int32_t endPos = info[2].As<Napi::Number>().Int32Value();
+    AddonThreadpool* threadpool = Napi::ObjectWrap<AddonThreadpool>::Unwrap(info[0].As<Napi::Object>());
 
-    bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, startPos, endPos);
+    // a separate pool for batch (prompt processing) work,
+    // so it can use a different thread count or CPU mask than single-token decode
+    AddonThreadpool* batchThreadpool = info.Length() > 1 && info[1].IsObject()
+        ? Napi::ObjectWrap<AddonThreadpool>::Unwrap(info[1].As<Napi::Object>())
+        : nullptr;
 
-    return Napi::Boolean::New(info.Env(), result);
+    if (threadpool->disposed || (batchThreadpool != nullptr && batchThreadpool->disposed)) {
+        Napi::Error::New(info.Env(), "Threadpool is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    detachThreadpools();
+
+    llama_attach_threadpool(
+        ctx,
+        threadpool->threadpool,
+        batchThreadpool == nullptr ? nullptr : batchThreadpool->threadpool
+    );
+
+    // keep the attached pools alive for as long as the context uses them
+    threadpool->Ref();
+    attachedThreadpool = threadpool;
+
+    if (batchThreadpool != nullptr) {
+        batchThreadpool->Ref();
+        attachedBatchThreadpool = batchThreadpool;
+    }
+
+    return info.Env().Undefined();
 }
-Napi::Value AddonContext::ShiftSequenceTokenCells(const Napi::CallbackInfo& info) {
+
+Napi::Value AddonContext::DetachThreadpool(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
-    int32_t startPos = info[1].As<Napi::Number>().Int32Value();
-    int32_t endPos = info[2].As<Napi::Number>().Int32Value();
-    int32_t shiftDelta = info[3].As<Napi::Number>().Int32Value();
+    detachThreadpools();
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonContext::Reset(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // clears all sequences and perf counters without freeing the context,
+    // so the KV cache allocation survives and the context can serve a new workload
+    // without paying for a teardown and reallocation cycle
+    llama_memory_seq_rm(llama_get_memory(ctx), -1, -1, -1);
+    llama_perf_context_reset(ctx);
+    n_cur = 0;
+    kvCachePrefixes.clear();
+
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+
+        if (options.Has("threads")) {
+            const auto threads = options.Get("threads").As<Napi::Number>().Int32Value();
+            const auto resolvedThreads = threads == 0
+                ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
+                : threads;
+
+            if (llama_n_threads(ctx) != resolvedThreads) {
+                llama_set_n_threads(ctx, resolvedThreads, resolvedThreads);
+            }
+        }
+    }
+
+    return info.Env().Undefined();
+}
+
+// chunked sequence snapshot container written by the compressed save mode.
+// the state is RLE-compressed (PackBits) chunk by chunk, which captures the
+// long zero runs of unused KV regions without pulling in a compression dependency
+static const char sequenceSnapshotMagic[8] = {'N', 'L', 'C', 'S', 'E', 'Q', '0', '1'};
+static const char sequenceDeltaSnapshotMagic[8] = {'N', 'L', 'C', 'D', 'L', 'T', '0', '1'};
+static const size_t sequenceSnapshotChunkSize = 1 << 20;
+static const int sequenceSnapshotMaxChainDepth = 32;
+
+static void packBitsEncode(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& out) {
+    out.clear();
+
+    size_t i = 0;
+    while (i < srcSize) {
+        size_t runLength = 1;
+        while (i + runLength < srcSize && src[i + runLength] == src[i] && runLength < 128) {
+            runLength++;
+        }
+
+        if (runLength >= 3) {
+            out.push_back(static_cast<uint8_t>(257 - runLength));
+            out.push_back(src[i]);
+            i += runLength;
+            continue;
+        }
+
+        const size_t literalStart = i;
+        size_t literalLength = 0;
+        while (i < srcSize && literalLength < 128) {
+            size_t nextRunLength = 1;
+            while (i + nextRunLength < srcSize && src[i + nextRunLength] == src[i] && nextRunLength < 3) {
+                nextRunLength++;
+            }
 
-    llama_memory_seq_add(llama_get_memory(ctx), sequenceId, startPos, endPos, shiftDelta);
+            if (nextRunLength >= 3) {
+                break;
+            }
 
-    return info.Env().Undefined();
-}
-Napi::Value AddonContext::GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+            i++;
+            literalLength++;
+        }
+
+        out.push_back(static_cast<uint8_t>(literalLength - 1));
+        out.insert(out.end(), src + literalStart, src + literalStart + literalLength);
     }
+}
 
-    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+static bool packBitsDecode(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    size_t i = 0;
+    size_t o = 0;
 
+    while (i < srcSize) {
+        const int8_t control = static_cast<int8_t>(src[i++]);
 
-    const auto minPosition = llama_memory_seq_pos_min(llama_get_memory(ctx), sequenceId);
+        if (control >= 0) {
+            const size_t length = static_cast<size_t>(control) + 1;
+            if (i + length > srcSize || o + length > dstSize) {
+                return false;
+            }
 
-    return Napi::Number::New(info.Env(), minPosition);
-}
-Napi::Value AddonContext::GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+            memcpy(dst + o, src + i, length);
+            i += length;
+            o += length;
+        } else if (control != -128) {
+            const size_t length = static_cast<size_t>(1 - static_cast<int>(control));
+            if (i >= srcSize || o + length > dstSize) {
+                return false;
+            }
+
+            memset(dst + o, src[i++], length);
+            o += length;
+        }
     }
 
-    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    return o == dstSize;
+}
 
+// reads a compressed or delta snapshot file into "tokens" and "state".
+// delta snapshots reference a base snapshot file and store only the XOR against
+// its state, so the chain of base + deltas is replayed recursively
+static bool readSequenceSnapshotFile(
+    const std::string& filepath, size_t maxContextSize, std::vector<llama_token>& tokens, std::vector<uint8_t>& state,
+    std::string& error, int depth = 0
+) {
+    if (depth > sequenceSnapshotMaxChainDepth) {
+        error = "Sequence snapshot delta chain is too deep";
+        return false;
+    }
 
-    const auto maxPosition = llama_memory_seq_pos_max(llama_get_memory(ctx), sequenceId);
+    FILE* file = fopen(filepath.c_str(), "rb");
+    if (file == nullptr) {
+        error = "Failed to open file \"" + filepath + "\" for reading";
+        return false;
+    }
 
-    return Napi::Number::New(info.Env(), maxPosition);
-}
-Napi::Value AddonContext::DecodeBatch(const Napi::CallbackInfo& info) {
-    AddonContextDecodeBatchWorker* worker = new AddonContextDecodeBatchWorker(info.Env(), this);
-    worker->Queue();
-    return worker->GetPromise();
-}
-Napi::Value AddonContext::SampleToken(const Napi::CallbackInfo& info) {
-    AddonContextSampleTokenWorker* worker = new AddonContextSampleTokenWorker(info, this);
-    worker->Queue();
-    return worker->GetPromise();
-}
+    char magic[sizeof(sequenceSnapshotMagic)];
+    bool readSucceeded = fread(magic, sizeof(magic), 1, file) == 1;
 
-Napi::Value AddonContext::GetEmbedding(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
+    const bool isDelta = readSucceeded && memcmp(magic, sequenceDeltaSnapshotMagic, sizeof(magic)) == 0;
+    readSucceeded = readSucceeded && (isDelta || memcmp(magic, sequenceSnapshotMagic, sizeof(magic)) == 0);
 
-    int32_t inputTokensLength = info[0].As<Napi::Number>().Int32Value();
-    int32_t maxVectorSize = (info.Length() > 1 && info[1].IsNumber()) ? info[1].As<Napi::Number>().Int32Value() : 0;
+    std::string basePath;
+    if (readSucceeded && isDelta) {
+        uint32_t basePathLength = 0;
+        readSucceeded = fread(&basePathLength, sizeof(basePathLength), 1, file) == 1 && basePathLength > 0 && basePathLength < (1 << 16);
 
-    if (inputTokensLength <= 0) {
-        Napi::Error::New(info.Env(), "Invalid input tokens length").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+        if (readSucceeded) {
+            basePath.resize(basePathLength);
+            readSucceeded = fread(&basePath[0], 1, basePathLength, file) == basePathLength;
+        }
     }
 
-    const int n_embd = llama_model_n_embd(model->model);
-    const enum llama_pooling_type pooling_type = llama_pooling_type(ctx);
-    const auto* embeddings = pooling_type == LLAMA_POOLING_TYPE_NONE ? NULL : llama_get_embeddings_seq(ctx, 0);
-    if (embeddings == NULL) {
-        embeddings = llama_get_embeddings_ith(ctx, inputTokensLength - 1);
-    }
+    uint32_t tokenCount = 0;
+    uint64_t stateSize = 0;
+    uint32_t chunkSize = 0;
 
-    if (embeddings == NULL) {
-        Napi::Error::New(info.Env(), std::string("Failed to get embeddings for token ") + std::to_string(inputTokensLength - 1)).ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+    if (readSucceeded) {
+        readSucceeded = fread(&tokenCount, sizeof(tokenCount), 1, file) == 1 && tokenCount <= maxContextSize;
     }
 
-    size_t resultSize = maxVectorSize == 0 ? n_embd : std::min(n_embd, maxVectorSize);
-    Napi::Float64Array result = Napi::Float64Array::New(info.Env(), resultSize);
-    for (size_t i = 0; i < resultSize; i++) {
-        result[i] = embeddings[i];
+    if (readSucceeded) {
+        tokens.resize(tokenCount);
+        readSucceeded = (tokenCount == 0 || fread(tokens.data(), sizeof(llama_token), tokenCount, file) == tokenCount) &&
+            fread(&stateSize, sizeof(stateSize), 1, file) == 1 &&
+            fread(&chunkSize, sizeof(chunkSize), 1, file) == 1 &&
+            chunkSize > 0;
     }
 
-    return result;
-}
+    std::vector<uint8_t> encodedChunk;
+    if (readSucceeded) {
+        state.resize(stateSize);
 
-Napi::Value AddonContext::GetStateSize(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
+        for (size_t offset = 0; readSucceeded && offset < stateSize; offset += chunkSize) {
+            const size_t rawChunkSize = std::min(static_cast<size_t>(chunkSize), static_cast<size_t>(stateSize) - offset);
 
-    return Napi::Number::From(info.Env(), llama_state_get_size(ctx));
-}
+            uint32_t storedSize = 0;
+            readSucceeded = fread(&storedSize, sizeof(storedSize), 1, file) == 1 && storedSize <= rawChunkSize;
 
-Napi::Value AddonContext::GetThreads(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+            if (readSucceeded && storedSize == rawChunkSize) {
+                // chunk was stored raw
+                readSucceeded = fread(state.data() + offset, 1, rawChunkSize, file) == rawChunkSize;
+            } else if (readSucceeded) {
+                encodedChunk.resize(storedSize);
+                readSucceeded = fread(encodedChunk.data(), 1, storedSize, file) == storedSize &&
+                    packBitsDecode(encodedChunk.data(), storedSize, state.data() + offset, rawChunkSize);
+            }
+        }
     }
 
-    return Napi::Number::From(info.Env(), llama_n_threads(ctx));
-}
+    fclose(file);
 
-Napi::Value AddonContext::SetThreads(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+    if (!readSucceeded) {
+        error = "Failed to read sequence snapshot file \"" + filepath + "\"";
+        return false;
     }
 
-    const auto threads = info[0].As<Napi::Number>().Int32Value();
-    const auto resolvedThreads = threads == 0
-        ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
-        : threads;
+    if (isDelta) {
+        std::vector<llama_token> baseTokens;
+        std::vector<uint8_t> baseState;
+        if (!readSequenceSnapshotFile(basePath, maxContextSize, baseTokens, baseState, error, depth + 1)) {
+            return false;
+        }
 
-    if (llama_n_threads(ctx) != resolvedThreads) {
-        llama_set_n_threads(ctx, resolvedThreads, resolvedThreads);
+        const size_t sharedSize = std::min(state.size(), baseState.size());
+        for (size_t i = 0; i < sharedSize; i++) {
+            state[i] ^= baseState[i];
+        }
     }
 
-    return info.Env().Undefined();
+    return true;
 }
 
 class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
@@ -740,6 +2482,8 @@ class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
         std::string filepath;
         llama_seq_id sequenceId;
         std::vector<llama_token> tokens;
+        bool compressed = false;
+        std::string deltaBasePath;
         size_t savedFileSize = 0;
 
         AddonContextSaveSequenceStateToFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
@@ -756,6 +2500,18 @@ class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
             for (size_t i = 0; i < tokens.size(); i++) {
                 tokens[i] = inputTokens[i];
             }
+
+            if (info.Length() > 3 && info[3].IsObject()) {
+                Napi::Object options = info[3].As<Napi::Object>();
+
+                if (options.Has("compressed")) {
+                    compressed = options.Get("compressed").As<Napi::Boolean>().Value();
+                }
+
+                if (options.Has("deltaBase") && options.Get("deltaBase").IsString()) {
+                    deltaBasePath = options.Get("deltaBase").As<Napi::String>().Utf8Value();
+                }
+            }
         }
         ~AddonContextSaveSequenceStateToFileWorker() {
             context->Unref();
@@ -770,6 +2526,11 @@ class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
+                if (compressed || !deltaBasePath.empty()) {
+                    ExecuteCompressed();
+                    return;
+                }
+
                 savedFileSize = llama_state_seq_save_file(context->ctx, filepath.c_str(), sequenceId, tokens.data(), tokens.size());
                 if (savedFileSize == 0) {
                     SetError("Failed to save state to file");
@@ -781,6 +2542,99 @@ class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
                 SetError("Unknown error when calling \"llama_state_seq_save_file\"");
             }
         }
+        void ExecuteCompressed() {
+            const size_t stateSize = llama_state_seq_get_size(context->ctx, sequenceId);
+            if (stateSize == 0) {
+                SetError("Failed to save state to file");
+                return;
+            }
+
+            std::vector<uint8_t> state(stateSize);
+            const size_t writtenStateSize = llama_state_seq_get_data(context->ctx, state.data(), stateSize, sequenceId);
+            if (writtenStateSize == 0) {
+                SetError("Failed to save state to file");
+                return;
+            }
+
+            const bool isDelta = !deltaBasePath.empty();
+            if (isDelta) {
+                std::vector<llama_token> baseTokens;
+                std::vector<uint8_t> baseState;
+                std::string error;
+                if (!readSequenceSnapshotFile(deltaBasePath, SIZE_MAX, baseTokens, baseState, error)) {
+                    SetError(error);
+                    return;
+                }
+
+                // store the XOR against the base state; the state bytes that didn't
+                // change since the base checkpoint become zero runs that the
+                // chunk compression collapses to almost nothing
+                const size_t sharedSize = std::min(writtenStateSize, baseState.size());
+                for (size_t i = 0; i < sharedSize; i++) {
+                    state[i] ^= baseState[i];
+                }
+            }
+
+            FILE* file = fopen(filepath.c_str(), "wb");
+            if (file == nullptr) {
+                SetError("Failed to open file for writing");
+                return;
+            }
+
+            const uint32_t tokenCount = static_cast<uint32_t>(tokens.size());
+            const uint64_t stateSize64 = static_cast<uint64_t>(writtenStateSize);
+            const uint32_t chunkSize = static_cast<uint32_t>(sequenceSnapshotChunkSize);
+            const uint32_t basePathLength = static_cast<uint32_t>(deltaBasePath.size());
+
+            bool writeSucceeded = fwrite(isDelta ? sequenceDeltaSnapshotMagic : sequenceSnapshotMagic, sizeof(sequenceSnapshotMagic), 1, file) == 1 &&
+                (
+                    !isDelta || (
+                        fwrite(&basePathLength, sizeof(basePathLength), 1, file) == 1 &&
+                        fwrite(deltaBasePath.data(), 1, basePathLength, file) == basePathLength
+                    )
+                ) &&
+                fwrite(&tokenCount, sizeof(tokenCount), 1, file) == 1 &&
+                (tokenCount == 0 || fwrite(tokens.data(), sizeof(llama_token), tokenCount, file) == tokenCount) &&
+                fwrite(&stateSize64, sizeof(stateSize64), 1, file) == 1 &&
+                fwrite(&chunkSize, sizeof(chunkSize), 1, file) == 1;
+
+            // compress and write the state chunk by chunk, so only one chunk of
+            // compression output is held in memory at a time.
+            // the file is synced once at the end instead of after every chunk
+            std::vector<uint8_t> encodedChunk;
+            for (size_t offset = 0; writeSucceeded && offset < writtenStateSize; offset += sequenceSnapshotChunkSize) {
+                const size_t rawChunkSize = std::min(sequenceSnapshotChunkSize, writtenStateSize - offset);
+                packBitsEncode(state.data() + offset, rawChunkSize, encodedChunk);
+
+                // store the chunk raw when compression doesn't shrink it
+                const bool storeRaw = encodedChunk.size() >= rawChunkSize;
+                const uint32_t storedSize = static_cast<uint32_t>(storeRaw ? rawChunkSize : encodedChunk.size());
+                const uint8_t* storedData = storeRaw ? state.data() + offset : encodedChunk.data();
+
+                writeSucceeded = fwrite(&storedSize, sizeof(storedSize), 1, file) == 1 &&
+                    fwrite(storedData, 1, storedSize, file) == storedSize;
+            }
+
+            if (writeSucceeded) {
+                writeSucceeded = fflush(file) == 0;
+
+#ifndef _WIN32
+                if (writeSucceeded) {
+                    writeSucceeded = fdatasync(fileno(file)) == 0;
+                }
+#endif
+            }
+
+            const long fileSize = writeSucceeded ? ftell(file) : 0;
+            fclose(file);
+
+            if (!writeSucceeded || fileSize <= 0) {
+                SetError("Failed to save state to file");
+                return;
+            }
+
+            savedFileSize = static_cast<size_t>(fileSize);
+        }
         void OnOK() {
             deferred.Resolve(Napi::Number::New(Env(), savedFileSize));
         }
@@ -832,6 +2686,11 @@ class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
+                if (IsCompressedSnapshotFile()) {
+                    ExecuteCompressed();
+                    return;
+                }
+
                 size_t tokenCount = 0;
                 const size_t fileSize = llama_state_seq_load_file(context->ctx, filepath.c_str(), sequenceId, tokens.data(), tokens.size(), &tokenCount);
                 if (fileSize == 0) {
@@ -846,6 +2705,38 @@ class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
                 SetError("Unknown error when calling \"llama_state_seq_load_file\"");
             }
         }
+        bool IsCompressedSnapshotFile() {
+            FILE* file = fopen(filepath.c_str(), "rb");
+            if (file == nullptr) {
+                return false;
+            }
+
+            char magic[sizeof(sequenceSnapshotMagic)];
+            const bool isCompressed = fread(magic, sizeof(magic), 1, file) == 1 && (
+                memcmp(magic, sequenceSnapshotMagic, sizeof(magic)) == 0 ||
+                memcmp(magic, sequenceDeltaSnapshotMagic, sizeof(magic)) == 0
+            );
+
+            fclose(file);
+            return isCompressed;
+        }
+        void ExecuteCompressed() {
+            std::vector<uint8_t> state;
+            std::string error;
+
+            if (!readSequenceSnapshotFile(filepath, maxContextSize, tokens, state, error)) {
+                SetError(error);
+                tokens.clear();
+                return;
+            }
+
+            const size_t readStateSize = llama_state_seq_set_data(context->ctx, state.data(), state.size(), sequenceId);
+            if (readStateSize == 0) {
+                SetError("Failed to load state from file. Current context sequence size may be smaller that the state of the file");
+                tokens.clear();
+                return;
+            }
+        }
         void OnOK() {
             size_t tokenCount = tokens.size();
             Napi::Uint32Array result = Napi::Uint32Array::New(Env(), tokenCount);
@@ -871,17 +2762,209 @@ Napi::Value AddonContext::LoadSequenceStateFromFile(const Napi::CallbackInfo& in
     return worker->GetPromise();
 }
 
+class AddonContextGetSequenceStateWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* context;
+        llama_seq_id sequenceId;
+        uint8_t* state = nullptr;
+        size_t stateSize = 0;
+
+        AddonContextGetSequenceStateWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextGetSequenceStateWorker"),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            context->Ref();
+
+            sequenceId = info[0].As<Napi::Number>().Int32Value();
+        }
+        ~AddonContextGetSequenceStateWorker() {
+            if (state != nullptr) {
+                delete[] state;
+                state = nullptr;
+            }
+
+            context->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                stateSize = llama_state_seq_get_size(context->ctx, sequenceId);
+                if (stateSize == 0) {
+                    SetError("Failed to get sequence state");
+                    return;
+                }
+
+                state = new uint8_t[stateSize];
+                const size_t writtenStateSize = llama_state_seq_get_data(context->ctx, state, stateSize, sequenceId);
+                if (writtenStateSize == 0) {
+                    SetError("Failed to get sequence state");
+                    return;
+                }
+
+                stateSize = writtenStateSize;
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_state_seq_get_data\"");
+            }
+        }
+        void OnOK() {
+            // hand the state buffer over to JS without copying it
+            auto arrayBuffer = Napi::ArrayBuffer::New(Env(), state, stateSize, [](Napi::Env env, void* data) {
+                delete[] static_cast<uint8_t*>(data);
+            });
+            state = nullptr;
+
+            deferred.Resolve(Napi::Uint8Array::New(Env(), stateSize, arrayBuffer, 0));
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::GetSequenceState(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextGetSequenceStateWorker* worker = new AddonContextGetSequenceStateWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonContextSetSequenceStateWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* context;
+        llama_seq_id sequenceId;
+        Napi::Reference<Napi::Uint8Array> stateRef;
+        const uint8_t* state;
+        size_t stateSize;
+
+        AddonContextSetSequenceStateWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextSetSequenceStateWorker"),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            context->Ref();
+
+            sequenceId = info[0].As<Napi::Number>().Int32Value();
+
+            // reference the given state buffer instead of copying it;
+            // the reference keeps it alive for the duration of the worker
+            Napi::Uint8Array stateTypedArray = info[1].As<Napi::Uint8Array>();
+            stateRef = Napi::Persistent(stateTypedArray);
+            state = stateTypedArray.Data();
+            stateSize = stateTypedArray.ElementLength();
+        }
+        ~AddonContextSetSequenceStateWorker() {
+            stateRef.Unref();
+            context->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                const size_t readStateSize = llama_state_seq_set_data(context->ctx, state, stateSize, sequenceId);
+                if (readStateSize == 0) {
+                    SetError("Failed to set sequence state. Current context sequence size may be smaller than the given state");
+                    return;
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_state_seq_set_data\"");
+            }
+        }
+        void OnOK() {
+            deferred.Resolve(Env().Undefined());
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::SetSequenceState(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextSetSequenceStateWorker* worker = new AddonContextSetSequenceStateWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
 Napi::Value AddonContext::PrintTimings(const Napi::CallbackInfo& info) {
     llama_perf_context_print(ctx);
     llama_perf_context_reset(ctx);
     return info.Env().Undefined();
 }
 
+Napi::Value AddonContext::GetPerfMetrics(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Object result = Napi::Object::New(info.Env());
+
+    if (contextLoaded) {
+        // zeros unless the context was created with performance tracking enabled
+        const auto perfData = llama_perf_context(ctx);
+
+        result.Set("loadMs", Napi::Number::From(info.Env(), perfData.t_load_ms));
+        result.Set("promptTokenCount", Napi::Number::From(info.Env(), perfData.n_p_eval));
+        result.Set("promptMs", Napi::Number::From(info.Env(), perfData.t_p_eval_ms));
+        result.Set("evalTokenCount", Napi::Number::From(info.Env(), perfData.n_eval));
+        result.Set("evalMs", Napi::Number::From(info.Env(), perfData.t_eval_ms));
+    }
+
+    result.Set("decodeCallCount", Napi::Number::From(info.Env(), decodeCallCount.load(std::memory_order_relaxed)));
+    result.Set("decodeTotalMs", Napi::Number::From(info.Env(), decodeTotalTimeUs.load(std::memory_order_relaxed) / 1000.0));
+    result.Set("decodedTokenCount", Napi::Number::From(info.Env(), decodedTokenCount.load(std::memory_order_relaxed)));
+    result.Set(
+        "decodeBatchCapacityTokenCount",
+        Napi::Number::From(info.Env(), decodeBatchCapacityTokenCount.load(std::memory_order_relaxed))
+    );
+
+    Napi::Array histogramBucketMaxMs = Napi::Array::New(info.Env(), decodeTimeHistogramBucketCount);
+    Napi::Array histogramCounts = Napi::Array::New(info.Env(), decodeTimeHistogramBucketCount);
+    for (size_t i = 0; i < decodeTimeHistogramBucketCount; i++) {
+        histogramBucketMaxMs[i] = decodeTimeHistogramBucketMaxUs[i] == UINT64_MAX
+            ? Napi::Number::From(info.Env(), std::numeric_limits<double>::infinity())
+            : Napi::Number::From(info.Env(), decodeTimeHistogramBucketMaxUs[i] / 1000.0);
+        histogramCounts[i] = Napi::Number::From(info.Env(), decodeTimeHistogram[i].load(std::memory_order_relaxed));
+    }
+    result.Set("decodeTimeHistogramBucketMaxMs", histogramBucketMaxMs);
+    result.Set("decodeTimeHistogramCounts", histogramCounts);
+
+    result.Set("samplerCallCount", Napi::Number::From(info.Env(), samplerCallCount.load(std::memory_order_relaxed)));
+    result.Set("samplerTotalMs", Napi::Number::From(info.Env(), samplerTotalTimeUs.load(std::memory_order_relaxed) / 1000.0));
+
+    // how long async workers sat in the libuv queue before running - the best
+    // available proxy for thread pool contention
+    result.Set("queueWaitCallCount", Napi::Number::From(info.Env(), queueWaitCallCount.load(std::memory_order_relaxed)));
+    result.Set("queueWaitTotalMs", Napi::Number::From(info.Env(), queueWaitTotalTimeUs.load(std::memory_order_relaxed) / 1000.0));
+
+    return result;
+}
+
 Napi::Value AddonContext::EnsureDraftContextIsCompatibleForSpeculative(const Napi::CallbackInfo& info) {
     constexpr auto vocabSizeMaxDifference = 128; // SPEC_VOCAB_MAX_SIZE_DIFFERENCE
     constexpr auto vocabCheckStartTokenId = 5; // SPEC_VOCAB_CHECK_START_TOKEN_ID
 
-    const AddonContext * draftContext = Napi::ObjectWrap<AddonContext>::Unwrap(info[0].As<Napi::Object>());
+    AddonContext * draftContext = Napi::ObjectWrap<AddonContext>::Unwrap(info[0].As<Napi::Object>());
     const auto currentCtx = ctx;
     const auto draftCtx = draftContext->ctx;
     const auto currentModel = model->model;
@@ -889,6 +2972,12 @@ Napi::Value AddonContext::EnsureDraftContextIsCompatibleForSpeculative(const Nap
     const auto currentVocab = model->vocab;
     const auto draftVocab = draftContext->model->vocab;
 
+    // matching vocabulary fingerprints make the full vocabulary scan below unnecessary;
+    // the scan only runs when the fingerprints differ, to produce a detailed error
+    if (model->getVocabHash() == draftContext->model->getVocabHash()) {
+        return info.Env().Undefined();
+    }
+
     if (llama_vocab_type(currentVocab) != llama_vocab_type(draftVocab)) {
         Napi::Error::New(info.Env(), "Speculative draft model vocabulary type must match the target model vocabulary type").ThrowAsJavaScriptException();
         return info.Env().Undefined();
@@ -954,22 +3043,40 @@ void AddonContext::init(Napi::Object exports) {
                 InstanceMethod("init", &AddonContext::Init),
                 InstanceMethod("getContextSize", &AddonContext::GetContextSize),
                 InstanceMethod("initBatch", &AddonContext::InitBatch),
+                InstanceMethod("reserveBatch", &AddonContext::ReserveBatch),
+                InstanceMethod("shrinkBatch", &AddonContext::ShrinkBatch),
                 InstanceMethod("addToBatch", &AddonContext::AddToBatch),
+                InstanceMethod("setBatch", &AddonContext::SetBatch),
                 InstanceMethod("disposeSequence", &AddonContext::DisposeSequence),
                 InstanceMethod("removeTokenCellsFromSequence", &AddonContext::RemoveTokenCellsFromSequence),
                 InstanceMethod("shiftSequenceTokenCells", &AddonContext::ShiftSequenceTokenCells),
+                InstanceMethod("copySequenceKvCache", &AddonContext::CopySequenceKvCache),
+                InstanceMethod("registerKvCachePrefix", &AddonContext::RegisterKvCachePrefix),
+                InstanceMethod("forkSequenceFromKvCachePrefix", &AddonContext::ForkSequenceFromKvCachePrefix),
+                InstanceMethod("getKvCachePrefixStats", &AddonContext::GetKvCachePrefixStats),
                 InstanceMethod("getSequenceKvCacheMinPosition", &AddonContext::GetSequenceKvCacheMinPosition),
                 InstanceMethod("getSequenceKvCacheMaxPosition", &AddonContext::GetSequenceKvCacheMaxPosition),
                 InstanceMethod("decodeBatch", &AddonContext::DecodeBatch),
                 InstanceMethod("sampleToken", &AddonContext::SampleToken),
+                InstanceMethod("sampleTokens", &AddonContext::SampleTokens),
+                InstanceMethod("decodeAndSample", &AddonContext::DecodeAndSample),
+                InstanceMethod("generate", &AddonContext::Generate),
+                InstanceMethod("speculativeDecode", &AddonContext::SpeculativeDecode),
                 InstanceMethod("getEmbedding", &AddonContext::GetEmbedding),
+                InstanceMethod("getEmbeddings", &AddonContext::GetEmbeddings),
                 InstanceMethod("getStateSize", &AddonContext::GetStateSize),
                 InstanceMethod("getThreads", &AddonContext::GetThreads),
                 InstanceMethod("setThreads", &AddonContext::SetThreads),
+                InstanceMethod("reset", &AddonContext::Reset),
+                InstanceMethod("attachThreadpool", &AddonContext::AttachThreadpool),
+                InstanceMethod("detachThreadpool", &AddonContext::DetachThreadpool),
                 InstanceMethod("printTimings", &AddonContext::PrintTimings),
+                InstanceMethod("getPerfMetrics", &AddonContext::GetPerfMetrics),
                 InstanceMethod("ensureDraftContextIsCompatibleForSpeculative", &AddonContext::EnsureDraftContextIsCompatibleForSpeculative),
                 InstanceMethod("saveSequenceStateToFile", &AddonContext::SaveSequenceStateToFile),
                 InstanceMethod("loadSequenceStateFromFile", &AddonContext::LoadSequenceStateFromFile),
+                InstanceMethod("getSequenceState", &AddonContext::GetSequenceState),
+                InstanceMethod("setSequenceState", &AddonContext::SetSequenceState),
                 InstanceMethod("setLora", &AddonContext::SetLora),
                 InstanceMethod("dispose", &AddonContext::Dispose),
             }
@@ -1,18 +1,28 @@
 #pragma once
+#include <atomic>
+#include <vector>
 #include "llama.h"
 #include "napi.h"
 #include "addonGlobals.h"
 #include "AddonSampler.h"
 
+class InferenceThread;
+
 class AddonContext : public Napi::ObjectWrap<AddonContext> {
     public:
         AddonModel* model;
         llama_context_params context_params;
         llama_context* ctx;
         llama_batch batch;
+        InferenceThread* inferenceThread = nullptr;
+        bool poolable = false;
+        uint64_t contextParamsHash = 0;
+        AddonThreadpool* attachedThreadpool = nullptr;
+        AddonThreadpool* attachedBatchThreadpool = nullptr;
         uint64_t batchMemorySize = 0;
         bool has_batch = false;
         int32_t batch_n_tokens = 0;
+        int32_t batch_allocated_tokens = 0;
         int n_cur = 0;
 
         uint64_t loadedContextMemorySize = 0;
@@ -20,36 +30,88 @@ class AddonContext : public Napi::ObjectWrap<AddonContext> {
 
         bool disposed = false;
 
+        // lightweight perf counters sampled by `getPerfMetrics` - plain atomics
+        // bumped from the worker threads, so reading them on demand is wait-free
+        // and cheap enough for production polling
+        static const size_t decodeTimeHistogramBucketCount = 8;
+        std::atomic<uint64_t> decodeCallCount{0};
+        std::atomic<uint64_t> decodeTotalTimeUs{0};
+        std::atomic<uint64_t> decodeTimeHistogram[decodeTimeHistogramBucketCount] = {};
+        std::atomic<uint64_t> decodedTokenCount{0};
+        std::atomic<uint64_t> decodeBatchCapacityTokenCount{0};
+        std::atomic<uint64_t> samplerCallCount{0};
+        std::atomic<uint64_t> samplerTotalTimeUs{0};
+        std::atomic<uint64_t> queueWaitCallCount{0};
+        std::atomic<uint64_t> queueWaitTotalTimeUs{0};
+
+        void recordDecodeTime(uint64_t timeUs, int32_t batchTokens);
+        void recordSamplerTime(uint64_t timeUs);
+        void recordQueueWait(uint64_t timeUs);
+
+        // registered prompt prefixes whose KV cells live in a source sequence;
+        // new sequences fork from them via llama_memory_seq_cp instead of
+        // re-decoding the prefix. touched only from the JS thread
+        struct KvCachePrefixEntry {
+            uint64_t tokensHash;
+            size_t tokenCount;
+            int32_t sequenceId;
+        };
+        std::vector<KvCachePrefixEntry> kvCachePrefixes;
+        uint64_t kvCachePrefixHitCount = 0;
+        uint64_t kvCachePrefixMissCount = 0;
+
+        void invalidateKvCachePrefixes(int32_t sequenceId, int32_t startPos, int32_t endPos);
+
         AddonContext(const Napi::CallbackInfo& info);
         ~AddonContext();
 
         void dispose();
         void disposeBatch();
+        void detachThreadpools();
+        void ensureBatchCapacity(int32_t n_tokens);
 
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
 
         Napi::Value GetContextSize(const Napi::CallbackInfo& info);
         Napi::Value InitBatch(const Napi::CallbackInfo& info);
+        Napi::Value ReserveBatch(const Napi::CallbackInfo& info);
+        Napi::Value ShrinkBatch(const Napi::CallbackInfo& info);
         Napi::Value DisposeBatch(const Napi::CallbackInfo& info);
         Napi::Value AddToBatch(const Napi::CallbackInfo& info);
+        Napi::Value SetBatch(const Napi::CallbackInfo& info);
         Napi::Value DisposeSequence(const Napi::CallbackInfo& info);
         Napi::Value RemoveTokenCellsFromSequence(const Napi::CallbackInfo& info);
         Napi::Value ShiftSequenceTokenCells(const Napi::CallbackInfo& info);
+        Napi::Value CopySequenceKvCache(const Napi::CallbackInfo& info);
+        Napi::Value RegisterKvCachePrefix(const Napi::CallbackInfo& info);
+        Napi::Value ForkSequenceFromKvCachePrefix(const Napi::CallbackInfo& info);
+        Napi::Value GetKvCachePrefixStats(const Napi::CallbackInfo& info);
         Napi::Value GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info);
         Napi::Value GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info);
         Napi::Value DecodeBatch(const Napi::CallbackInfo& info);
         Napi::Value SampleToken(const Napi::CallbackInfo& info);
+        Napi::Value SampleTokens(const Napi::CallbackInfo& info);
+        Napi::Value DecodeAndSample(const Napi::CallbackInfo& info);
+        Napi::Value Generate(const Napi::CallbackInfo& info);
+        Napi::Value SpeculativeDecode(const Napi::CallbackInfo& info);
 
         Napi::Value GetEmbedding(const Napi::CallbackInfo& info);
+        Napi::Value GetEmbeddings(const Napi::CallbackInfo& info);
         Napi::Value GetStateSize(const Napi::CallbackInfo& info);
         Napi::Value GetThreads(const Napi::CallbackInfo& info);
         Napi::Value SetThreads(const Napi::CallbackInfo& info);
+        Napi::Value Reset(const Napi::CallbackInfo& info);
+        Napi::Value AttachThreadpool(const Napi::CallbackInfo& info);
+        Napi::Value DetachThreadpool(const Napi::CallbackInfo& info);
 
         Napi::Value SaveSequenceStateToFile(const Napi::CallbackInfo& info);
         Napi::Value LoadSequenceStateFromFile(const Napi::CallbackInfo& info);
+        Napi::Value GetSequenceState(const Napi::CallbackInfo& info);
+        Napi::Value SetSequenceState(const Napi::CallbackInfo& info);
 
         Napi::Value PrintTimings(const Napi::CallbackInfo& info);
+        Napi::Value GetPerfMetrics(const Napi::CallbackInfo& info);
         Napi::Value EnsureDraftContextIsCompatibleForSpeculative(const Napi::CallbackInfo& info);
 
         Napi::Value SetLora(const Napi::CallbackInfo& info);
@@ -0,0 +1,126 @@
+#include "common/common.h"
+#include "llama.h"
+
+#include "AddonDetokenizerStream.h"
+
+// the longest prefix of "text" that only contains complete UTF-8 sequences
+static size_t completeUtf8PrefixLength(const std::string & text) {
+    size_t end = text.size();
+    size_t continuationBytes = 0;
+
+    while (end > 0 && (static_cast<unsigned char>(text[end - 1]) & 0xC0) == 0x80) {
+        end--;
+        continuationBytes++;
+    }
+
+    if (end == 0) {
+        return text.size() - continuationBytes;
+    }
+
+    const unsigned char leadByte = static_cast<unsigned char>(text[end - 1]);
+    size_t sequenceLength = 1;
+    if ((leadByte & 0xF8) == 0xF0) {
+        sequenceLength = 4;
+    } else if ((leadByte & 0xF0) == 0xE0) {
+        sequenceLength = 3;
+    } else if ((leadByte & 0xE0) == 0xC0) {
+        sequenceLength = 2;
+    }
+
+    if (continuationBytes + 1 < sequenceLength) {
+        // the last lead byte starts a sequence that isn't complete yet
+        return end - 1;
+    }
+
+    return text.size();
+}
+
+AddonDetokenizerStream::AddonDetokenizerStream(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonDetokenizerStream>(info) {
+    model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
+    model->Ref();
+}
+AddonDetokenizerStream::~AddonDetokenizerStream() {
+    dispose();
+}
+
+void AddonDetokenizerStream::dispose() {
+    if (disposed) {
+        return;
+    }
+
+    disposed = true;
+    model->Unref();
+}
+
+Napi::Value AddonDetokenizerStream::PushTokens(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "DetokenizerStream is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+    bool decodeSpecialTokens = info.Length() > 1 && info[1].IsBoolean()
+        ? info[1].As<Napi::Boolean>().Value()
+        : false;
+
+    if (tokens.ElementLength() > 0) {
+        pieceBuffer.resize(std::max(pieceBuffer.capacity(), static_cast<size_t>(tokens.ElementLength())));
+
+        int n_chars = llama_detokenize(
+            model->vocab, (llama_token*)tokens.Data(), tokens.ElementLength(), &pieceBuffer[0], pieceBuffer.size(), false, decodeSpecialTokens
+        );
+        if (n_chars < 0) {
+            pieceBuffer.resize(-n_chars);
+            n_chars = llama_detokenize(
+                model->vocab, (llama_token*)tokens.Data(), tokens.ElementLength(), &pieceBuffer[0], pieceBuffer.size(), false, decodeSpecialTokens
+            );
+            GGML_ASSERT(n_chars <= pieceBuffer.size());
+        }
+
+        pendingBytes.append(pieceBuffer.data(), n_chars);
+    }
+
+    // only materialize a JS string for the complete UTF-8 prefix and
+    // keep the partial tail for the next push
+    const size_t completeLength = completeUtf8PrefixLength(pendingBytes);
+    if (completeLength == 0) {
+        return Napi::String::New(info.Env(), "");
+    }
+
+    Napi::String result = Napi::String::New(info.Env(), pendingBytes.data(), completeLength);
+    pendingBytes.erase(0, completeLength);
+
+    return result;
+}
+
+Napi::Value AddonDetokenizerStream::Flush(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "DetokenizerStream is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::String result = Napi::String::New(info.Env(), pendingBytes);
+    pendingBytes.clear();
+
+    return result;
+}
+
+Napi::Value AddonDetokenizerStream::Dispose(const Napi::CallbackInfo& info) {
+    dispose();
+    return info.Env().Undefined();
+}
+
+void AddonDetokenizerStream::init(Napi::Object exports) {
+    exports.Set(
+        "AddonDetokenizerStream",
+        DefineClass(
+            exports.Env(),
+            "AddonDetokenizerStream",
+            {
+                InstanceMethod("pushTokens", &AddonDetokenizerStream::PushTokens),
+                InstanceMethod("flush", &AddonDetokenizerStream::Flush),
+                InstanceMethod("dispose", &AddonDetokenizerStream::Dispose),
+            }
+        )
+    );
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "llama.h"
+#include "napi.h"
+#include "addonGlobals.h"
+#include "AddonModel.h"
+
+// incremental detokenizer for streaming output.
+// keeps the partial-UTF-8 tail natively and reuses its buffers,
+// so steady-state streaming doesn't allocate per token
+class AddonDetokenizerStream : public Napi::ObjectWrap<AddonDetokenizerStream> {
+    public:
+        AddonModel* model;
+        std::string pendingBytes;
+        std::string pieceBuffer;
+
+        bool disposed = false;
+
+        AddonDetokenizerStream(const Napi::CallbackInfo& info);
+        ~AddonDetokenizerStream();
+
+        void dispose();
+
+        Napi::Value PushTokens(const Napi::CallbackInfo& info);
+        Napi::Value Flush(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
@@ -70,6 +70,38 @@ Napi::Value AddonGrammar::isTextCompatible(const Napi::CallbackInfo& info) {
     return Napi::Boolean::New(info.Env(), false);
 }
 
+bool AddonGrammar::getCachedTokenMask(uint64_t stateHash, std::vector<uint8_t> & mask) {
+    std::lock_guard<std::mutex> lock(tokenMaskCacheMutex);
+
+    const auto it = tokenMaskCache.find(stateHash);
+    if (it == tokenMaskCache.end()) {
+        return false;
+    }
+
+    tokenMaskCacheOrder.splice(tokenMaskCacheOrder.begin(), tokenMaskCacheOrder, it->second);
+    mask = it->second->second;
+    return true;
+}
+
+void AddonGrammar::setCachedTokenMask(uint64_t stateHash, const std::vector<uint8_t> & mask) {
+    std::lock_guard<std::mutex> lock(tokenMaskCacheMutex);
+
+    const auto it = tokenMaskCache.find(stateHash);
+    if (it != tokenMaskCache.end()) {
+        tokenMaskCacheOrder.splice(tokenMaskCacheOrder.begin(), tokenMaskCacheOrder, it->second);
+        it->second->second = mask;
+        return;
+    }
+
+    tokenMaskCacheOrder.emplace_front(stateHash, mask);
+    tokenMaskCache[stateHash] = tokenMaskCacheOrder.begin();
+
+    while (tokenMaskCacheOrder.size() > tokenMaskCacheCapacity) {
+        tokenMaskCache.erase(tokenMaskCacheOrder.back().first);
+        tokenMaskCacheOrder.pop_back();
+    }
+}
+
 void AddonGrammar::init(Napi::Object exports) {
     exports.Set(
         "AddonGrammar",
@@ -1,4 +1,8 @@
 #pragma once
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "llama.h"
 #include "common/common.h"
 #include "llama-grammar.h"
@@ -18,5 +22,18 @@ class AddonGrammar : public Napi::ObjectWrap<AddonGrammar> {
 
         Napi::Value isTextCompatible(const Napi::CallbackInfo& info);
 
+        // token mask cache shared across all evaluation states of this grammar,
+        // so concurrent sequences following the same grammar state pay the
+        // whole-vocab grammar evaluation cost roughly once per distinct state
+        bool getCachedTokenMask(uint64_t stateHash, std::vector<uint8_t> & mask);
+        void setCachedTokenMask(uint64_t stateHash, const std::vector<uint8_t> & mask);
+
         static void init(Napi::Object exports);
+
+    private:
+        static constexpr size_t tokenMaskCacheCapacity = 64;
+
+        std::mutex tokenMaskCacheMutex;
+        std::list<std::pair<uint64_t, std::vector<uint8_t>>> tokenMaskCacheOrder;
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, std::vector<uint8_t>>>::iterator> tokenMaskCache;
 };
\ No newline at end of file
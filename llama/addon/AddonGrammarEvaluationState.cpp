@@ -15,6 +15,7 @@ AddonGrammarEvaluationState::AddonGrammarEvaluationState(const Napi::CallbackInf
         grammarDef->Ref();
 
         sampler = llama_sampler_clone(existingState->sampler);
+        stateHash = existingState->stateHash;
     } else {
         model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
         model->Ref();
@@ -25,6 +26,11 @@ AddonGrammarEvaluationState::AddonGrammarEvaluationState(const Napi::CallbackInf
         sampler = llama_sampler_init_grammar(model->vocab, grammarDef->grammarCode.c_str(), grammarDef->rootRuleName.c_str());
     }
 }
+void AddonGrammarEvaluationState::registerAcceptedToken(llama_token token) {
+    stateHash ^= static_cast<uint64_t>(static_cast<uint32_t>(token));
+    stateHash *= 1099511628211ULL;
+}
+
 AddonGrammarEvaluationState::~AddonGrammarEvaluationState() {
     llama_sampler_free(sampler);
     grammarDef->Unref();
@@ -10,8 +10,15 @@ class AddonGrammarEvaluationState : public Napi::ObjectWrap<AddonGrammarEvaluati
         AddonGrammar* grammarDef;
         llama_sampler * sampler = nullptr;
 
+        // FNV-1a hash of the tokens accepted since the grammar root.
+        // used as the key of the token mask cache on the grammar definition,
+        // so evaluation states that followed the same token path share cached masks
+        uint64_t stateHash = 14695981039346656037ULL;
+
         AddonGrammarEvaluationState(const Napi::CallbackInfo& info);
         ~AddonGrammarEvaluationState();
 
+        void registerAcceptedToken(llama_token token);
+
         static void init(Napi::Object exports);
 };
\ No newline at end of file
@@ -1,4 +1,10 @@
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
+#include <thread>
 #include "addonGlobals.h"
 #include "globals/addonLog.h"
 #include "globals/addonProgress.h"
@@ -8,6 +14,14 @@
 #include "AddonModelData.h"
 #include "AddonModelLora.h"
 
+#ifdef _WIN32
+#define fseek64(file, offset, origin) _fseeki64(file, offset, origin)
+#define ftell64(file) _ftelli64(file)
+#else
+#define fseek64(file, offset, origin) fseeko(file, offset, origin)
+#define ftell64(file) ftello(file)
+#endif
+
 static Napi::Value getNapiToken(const Napi::CallbackInfo& info, const llama_vocab* vocab, llama_token token) {
     if (token < 0 || token == LLAMA_TOKEN_NULL) {
         return Napi::Number::From(info.Env(), -1);
@@ -36,6 +50,22 @@ static Napi::Value getNapiControlToken(const Napi::CallbackInfo& info, const lla
     return Napi::Number::From(info.Env(), token);
 }
 
+static void reportModelLoadProgress(AddonModel* addonModel, float progress) {
+    if (!addonModel->onLoadProgressEventCallbackSet) {
+        return;
+    }
+
+    addon_progress_event* data = new addon_progress_event {
+        progress
+    };
+
+    auto status = addonModel->addonThreadSafeOnLoadProgressEventCallback.NonBlockingCall(data);
+
+    if (status != napi_ok) {
+        delete data;
+    }
+}
+
 static bool llamaModelParamsProgressCallback(float progress, void * user_data) {
     AddonModel* addonModel = (AddonModel *) user_data;
     unsigned percentage = (unsigned) (100 * progress);
@@ -53,17 +83,9 @@ static bool llamaModelParamsProgressCallback(float progress, void * user_data) {
     if (progress > addonModel->rawModelLoadPercentage) {
         addonModel->rawModelLoadPercentage = progress;
 
-        if (addonModel->onLoadProgressEventCallbackSet) {
-            addon_progress_event* data = new addon_progress_event {
-                progress
-            };
-
-            auto status = addonModel->addonThreadSafeOnLoadProgressEventCallback.NonBlockingCall(data);
-
-            if (status != napi_ok) {
-                delete data;
-            }
-        }
+        // when a prefetch phase follows the load, the load only covers
+        // the first part of the reported progress range
+        reportModelLoadProgress(addonModel, progress * addonModel->loadProgressScale);
     }
 
     return !(addonModel->abortModelLoad);
@@ -91,19 +113,145 @@ class AddonModelLoadModelWorker : public Napi::AsyncWorker {
         Napi::Promise::Deferred deferred;
 
         void Execute() {
+            bool owningLoad = false;
+
             try {
+                model->sharedModelKey = model->computeSharedModelKey();
+
+                llama_model* sharedModel = AddonModelRegistry::acquireOrBeginLoad(model->sharedModelKey);
+                if (sharedModel != nullptr) {
+                    // another environment in this process already loaded the same model
+                    // with the same params, so reuse its weights instead of reloading
+                    model->model = sharedModel;
+                    model->vocab = llama_model_get_vocab(model->model);
+                    model->modelLoaded = true;
+                    model->attachedToSharedModel = true;
+
+                    reportModelLoadProgress(model, 1.0f);
+                    return;
+                }
+
+                owningLoad = true;
                 model->model = llama_model_load_from_file(model->modelPath.c_str(), model->model_params);
                 model->vocab = llama_model_get_vocab(model->model);
 
                 model->modelLoaded = model->model != nullptr && model->model != NULL;
+
+                AddonModelRegistry::finishLoad(model->sharedModelKey, model->modelLoaded ? model->model : nullptr);
+                owningLoad = false;
+
+                if (model->modelLoaded && model->prefetch && model->model_params.use_mmap && !model->abortModelLoad) {
+                    prefetchModelPages();
+                }
             } catch (const std::exception& e) {
+                if (owningLoad) {
+                    AddonModelRegistry::finishLoad(model->sharedModelKey, nullptr);
+                }
+
                 SetError(e.what());
             } catch(...) {
+                if (owningLoad) {
+                    AddonModelRegistry::finishLoad(model->sharedModelKey, nullptr);
+                }
+
                 SetError("Unknown error when calling \"llama_model_load_from_file\"");
             }
         }
+
+        // with mmap the load returns quickly and the weight pages are faulted in lazily,
+        // single-threaded, on first use. reading the model file from a pool of threads
+        // warms the page cache up front, so the first evaluation doesn't stall on disk
+        void prefetchModelPages() {
+            FILE* file = fopen(model->modelPath.c_str(), "rb");
+            if (file == nullptr) {
+                return;
+            }
+
+            fseek64(file, 0, SEEK_END);
+            const int64_t fileEnd = ftell64(file);
+            fclose(file);
+
+            if (fileEnd <= 0) {
+                return;
+            }
+
+            const uint64_t fileSize = static_cast<uint64_t>(fileEnd);
+
+            // fully offloaded layers are read and uploaded to the GPU during the load itself,
+            // so only the part of the file holding CPU-resident weights is warmed.
+            // tensors are laid out in roughly layer order and the last layers get offloaded first,
+            // so the CPU-resident weights occupy the beginning of the file
+            uint64_t warmSize = fileSize;
+            const int32_t totalLayers = static_cast<int32_t>(llama_model_n_layer(model->model));
+            if (model->model_params.n_gpu_layers > 0 && totalLayers > 0) {
+                const auto offloadedLayers = std::min(model->model_params.n_gpu_layers, totalLayers + 1);
+                const float cpuFraction = 1.0f - (static_cast<float>(offloadedLayers) / static_cast<float>(totalLayers + 1));
+                warmSize = static_cast<uint64_t>(fileSize * cpuFraction);
+            }
+
+            if (warmSize == 0) {
+                reportModelLoadProgress(model, 1.0f);
+                return;
+            }
+
+            const auto threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+            const uint64_t sliceSize = (warmSize + threadCount - 1) / threadCount;
+
+            std::atomic<uint64_t> warmedBytes(0);
+            std::atomic<unsigned> lastReportedPercentage(0);
+
+            std::vector<std::thread> threads;
+            threads.reserve(threadCount);
+            for (unsigned threadIndex = 0; threadIndex < threadCount; threadIndex++) {
+                threads.emplace_back([this, threadIndex, sliceSize, warmSize, &warmedBytes, &lastReportedPercentage]() {
+                    const uint64_t sliceStart = threadIndex * sliceSize;
+                    const uint64_t sliceEnd = std::min(sliceStart + sliceSize, warmSize);
+                    if (sliceStart >= sliceEnd) {
+                        return;
+                    }
+
+                    FILE* sliceFile = fopen(model->modelPath.c_str(), "rb");
+                    if (sliceFile == nullptr) {
+                        return;
+                    }
+
+                    std::vector<uint8_t> buffer(1 << 20);
+                    uint64_t offset = sliceStart;
+                    fseek64(sliceFile, static_cast<int64_t>(sliceStart), SEEK_SET);
+
+                    while (offset < sliceEnd && !model->abortModelLoad) {
+                        const size_t readSize = static_cast<size_t>(std::min<uint64_t>(buffer.size(), sliceEnd - offset));
+                        if (fread(buffer.data(), 1, readSize, sliceFile) != readSize) {
+                            break;
+                        }
+
+                        offset += readSize;
+
+                        const uint64_t totalWarmed = warmedBytes.fetch_add(readSize) + readSize;
+                        const unsigned percentage = static_cast<unsigned>((100 * totalWarmed) / warmSize);
+                        unsigned lastPercentage = lastReportedPercentage.load();
+                        if (percentage > lastPercentage && lastReportedPercentage.compare_exchange_strong(lastPercentage, percentage)) {
+                            // the load phase reported [0, loadProgressScale]; the prefetch phase reports the rest
+                            reportModelLoadProgress(
+                                model,
+                                model->loadProgressScale + (1.0f - model->loadProgressScale) * (static_cast<float>(percentage) / 100.0f)
+                            );
+                        }
+                    }
+
+                    fclose(sliceFile);
+                });
+            }
+
+            for (auto & thread : threads) {
+                thread.join();
+            }
+        }
         void OnOK() {
-            if (model->modelLoaded) {
+            if (model->modelLoaded && !model->attachedToSharedModel) {
+                // when the model is shared, only the environment that performed the load
+                // accounts for the weights - they exist once in the process,
+                // no matter how many environments attach to them
                 uint64_t modelSize = llama_model_size(model->model);
                 adjustNapiExternalMemoryAdd(Env(), modelSize);
                 model->loadedModelSize = modelSize;
@@ -142,7 +290,14 @@ class AddonModelUnloadModelWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                llama_model_free(model->model);
+                if (model->data != nullptr) {
+                    // pooled contexts reference the model, so they must go first
+                    model->data->freePooledContexts();
+                }
+
+                if (AddonModelRegistry::release(model->sharedModelKey)) {
+                    llama_model_free(model->model);
+                }
                 model->modelLoaded = false;
 
                 model->dispose();
@@ -225,6 +380,137 @@ class AddonModelLoadLoraWorker : public Napi::AsyncWorker {
         }
 };
 
+class AddonModelTokenizeBatchWorker : public Napi::AsyncWorker {
+    public:
+        AddonModel* model;
+        bool specialTokens;
+
+        // the referenced input array keeps buffer-backed inputs alive while the worker runs,
+        // so buffer contents can be tokenized in place without a UTF-8 re-copy
+        Napi::Reference<Napi::Array> inputsRef;
+        std::vector<std::pair<const char*, size_t>> inputs;
+        std::vector<std::string> ownedInputs;
+        std::vector<std::vector<llama_token>> results;
+
+        AddonModelTokenizeBatchWorker(const Napi::CallbackInfo& info, AddonModel* model)
+            : Napi::AsyncWorker(info.Env(), "AddonModelTokenizeBatchWorker"),
+              model(model),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            model->Ref();
+
+            Napi::Array inputsArray = info[0].As<Napi::Array>();
+            specialTokens = info[1].As<Napi::Boolean>().Value();
+
+            inputsRef = Napi::Persistent(inputsArray);
+
+            inputs.reserve(inputsArray.Length());
+            ownedInputs.reserve(inputsArray.Length());
+            for (uint32_t i = 0; i < inputsArray.Length(); i++) {
+                const auto input = inputsArray.Get(i);
+
+                if (input.IsBuffer()) {
+                    Napi::Buffer<char> buffer = input.As<Napi::Buffer<char>>();
+                    inputs.emplace_back(buffer.Data(), buffer.Length());
+                } else {
+                    ownedInputs.push_back(input.As<Napi::String>().Utf8Value());
+                    inputs.emplace_back(ownedInputs.back().data(), ownedInputs.back().size());
+                }
+            }
+
+            results.resize(inputs.size());
+        }
+        ~AddonModelTokenizeBatchWorker() {
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                const size_t inputCount = inputs.size();
+                const size_t threadCount = std::min(
+                    inputCount,
+                    static_cast<size_t>(std::max((int32_t)std::thread::hardware_concurrency(), 1))
+                );
+
+                if (threadCount <= 1) {
+                    for (size_t i = 0; i < inputCount; i++) {
+                        tokenizeInput(i);
+                    }
+                    return;
+                }
+
+                std::vector<std::thread> threads;
+                threads.reserve(threadCount);
+                for (size_t t = 0; t < threadCount; t++) {
+                    threads.emplace_back([this, t, threadCount, inputCount]() {
+                        for (size_t i = t; i < inputCount; i += threadCount) {
+                            tokenizeInput(i);
+                        }
+                    });
+                }
+
+                for (auto & thread : threads) {
+                    thread.join();
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"tokenizeBatch\"");
+            }
+        }
+
+        void tokenizeInput(size_t index) {
+            const auto [text, textLength] = inputs[index];
+            auto & tokens = results[index];
+
+            tokens.resize(textLength + 2);
+            int n_tokens = llama_tokenize(model->vocab, text, textLength, tokens.data(), tokens.size(), false, specialTokens);
+            if (n_tokens < 0) {
+                tokens.resize(-n_tokens);
+                n_tokens = llama_tokenize(model->vocab, text, textLength, tokens.data(), tokens.size(), false, specialTokens);
+                GGML_ASSERT(n_tokens >= 0);
+            }
+
+            tokens.resize(n_tokens);
+        }
+
+        void OnOK() {
+            size_t totalTokens = 0;
+            for (const auto & tokens : results) {
+                totalTokens += tokens.size();
+            }
+
+            // one packed token buffer plus an offsets array,
+            // so a whole batch crosses the boundary in two typed arrays
+            Napi::Uint32Array tokens = Napi::Uint32Array::New(Env(), totalTokens);
+            Napi::Uint32Array offsets = Napi::Uint32Array::New(Env(), results.size() + 1);
+
+            size_t pos = 0;
+            for (size_t i = 0; i < results.size(); i++) {
+                offsets[i] = static_cast<uint32_t>(pos);
+                for (size_t j = 0; j < results[i].size(); j++) {
+                    tokens[pos++] = static_cast<uint32_t>(results[i][j]);
+                }
+            }
+            offsets[results.size()] = static_cast<uint32_t>(pos);
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("tokens", tokens);
+            result.Set("offsets", offsets);
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
 AddonModel::AddonModel(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonModel>(info) {
     data = new AddonModelData();
     model_params = llama_model_default_params();
@@ -254,6 +540,35 @@ AddonModel::AddonModel(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonM
             model_params.n_gpu_layers = options.Get("gpuLayers").As<Napi::Number>().Int32Value();
         }
 
+        if (options.Has("mainGpu")) {
+            model_params.main_gpu = options.Get("mainGpu").As<Napi::Number>().Int32Value();
+        }
+
+        if (options.Has("splitMode")) {
+            const auto splitMode = options.Get("splitMode").As<Napi::String>().Utf8Value();
+
+            if (splitMode == "none") {
+                model_params.split_mode = LLAMA_SPLIT_MODE_NONE;
+            } else if (splitMode == "layer") {
+                model_params.split_mode = LLAMA_SPLIT_MODE_LAYER;
+            } else if (splitMode == "row") {
+                model_params.split_mode = LLAMA_SPLIT_MODE_ROW;
+            }
+        }
+
+        if (options.Has("tensorSplit")) {
+            Napi::Array tensorSplit = options.Get("tensorSplit").As<Napi::Array>();
+
+            tensor_split_values.reserve(tensorSplit.Length());
+            for (uint32_t i = 0; i < tensorSplit.Length(); i++) {
+                tensor_split_values.push_back(tensorSplit.Get(i).As<Napi::Number>().FloatValue());
+            }
+
+            if (!tensor_split_values.empty()) {
+                model_params.tensor_split = tensor_split_values.data();
+            }
+        }
+
         if (options.Has("vocabOnly")) {
             model_params.vocab_only = options.Get("vocabOnly").As<Napi::Boolean>().Value();
         }
@@ -270,6 +585,16 @@ AddonModel::AddonModel(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonM
             model_params.check_tensors = options.Get("checkTensors").As<Napi::Boolean>().Value();
         }
 
+        if (options.Has("prefetch")) {
+            prefetch = options.Get("prefetch").As<Napi::Boolean>().Value();
+
+            if (prefetch && model_params.use_mmap) {
+                // the load itself only covers the first half of the reported
+                // progress range; the prefetch phase covers the rest
+                loadProgressScale = 0.5f;
+            }
+        }
+
         if (options.Has("onLoadProgress")) {
             auto onLoadProgressJSCallback = options.Get("onLoadProgress").As<Napi::Function>();
             if (onLoadProgressJSCallback.IsFunction()) {
@@ -370,7 +695,14 @@ void AddonModel::dispose() {
     disposed = true;
     if (modelLoaded) {
         modelLoaded = false;
-        llama_model_free(model);
+        if (data != nullptr) {
+            // pooled contexts reference the model, so they must go first
+            data->freePooledContexts();
+        }
+
+        if (AddonModelRegistry::release(sharedModelKey)) {
+            llama_model_free(model);
+        }
 
         adjustNapiExternalMemorySubtract(Env(), loadedModelSize);
         loadedModelSize = 0;
@@ -446,6 +778,16 @@ Napi::Value AddonModel::Tokenize(const Napi::CallbackInfo& info) {
 
     return result;
 }
+Napi::Value AddonModel::TokenizeBatch(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonModelTokenizeBatchWorker* worker = new AddonModelTokenizeBatchWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
 Napi::Value AddonModel::Detokenize(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
@@ -657,6 +999,121 @@ Napi::Value AddonModel::GetModelSize(const Napi::CallbackInfo& info) {
     return Napi::Number::From(info.Env(), llama_model_size(model));
 }
 
+uint64_t AddonModel::getVocabHash() {
+    if (vocabHashComputed) {
+        return vocabHash;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    const auto hashValue = [&hash](uint64_t value) {
+        for (size_t i = 0; i < sizeof(value); i++) {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    hashValue(static_cast<uint64_t>(llama_vocab_type(vocab)));
+    hashValue(static_cast<uint64_t>(llama_vocab_get_add_bos(vocab)));
+    hashValue(static_cast<uint64_t>(llama_vocab_get_add_eos(vocab)));
+    hashValue(static_cast<uint64_t>(static_cast<uint32_t>(llama_vocab_bos(vocab))));
+    hashValue(static_cast<uint64_t>(static_cast<uint32_t>(llama_vocab_eos(vocab))));
+
+    const int vocabSize = llama_vocab_n_tokens(vocab);
+    hashValue(static_cast<uint64_t>(vocabSize));
+
+    for (int i = 0; i < vocabSize; i++) {
+        const char* tokenText = llama_vocab_get_text(vocab, i);
+        for (const char* c = tokenText; *c != '\0'; c++) {
+            hash ^= static_cast<uint8_t>(*c);
+            hash *= 1099511628211ULL;
+        }
+
+        // separate token texts so shifted boundaries produce different hashes
+        hash ^= 0xFF;
+        hash *= 1099511628211ULL;
+    }
+
+    vocabHash = hash;
+    vocabHashComputed = true;
+    return vocabHash;
+}
+std::string AddonModel::computeSharedModelKey() {
+    std::string canonicalPath = modelPath;
+
+#ifdef _WIN32
+    char resolvedPath[_MAX_PATH];
+    if (_fullpath(resolvedPath, modelPath.c_str(), sizeof(resolvedPath)) != nullptr) {
+        canonicalPath = resolvedPath;
+    }
+#else
+    char resolvedPath[PATH_MAX];
+    if (realpath(modelPath.c_str(), resolvedPath) != nullptr) {
+        canonicalPath = resolvedPath;
+    }
+#endif
+
+    // two loads can only share weights when every param that affects
+    // how the weights end up in memory matches
+    uint64_t hash = 14695981039346656037ULL;
+    const auto hashBytes = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    const auto hashValue = [&hashBytes](uint64_t value) {
+        hashBytes(&value, sizeof(value));
+    };
+
+    hashValue(static_cast<uint64_t>(static_cast<int64_t>(model_params.n_gpu_layers)));
+    hashValue(static_cast<uint64_t>(static_cast<int64_t>(model_params.split_mode)));
+    hashValue(static_cast<uint64_t>(static_cast<int64_t>(model_params.main_gpu)));
+    hashValue(static_cast<uint64_t>(model_params.vocab_only));
+    hashValue(static_cast<uint64_t>(model_params.use_mmap));
+    hashValue(static_cast<uint64_t>(model_params.use_mlock));
+    hashValue(static_cast<uint64_t>(model_params.check_tensors));
+
+    hashValue(static_cast<uint64_t>(tensor_split_values.size()));
+    for (const float value : tensor_split_values) {
+        hashBytes(&value, sizeof(value));
+    }
+
+    hashValue(static_cast<uint64_t>(kv_overrides.size()));
+    for (const auto & kvo : kv_overrides) {
+        hashBytes(kvo.key, strnlen(kvo.key, sizeof(kvo.key)));
+        hashValue(static_cast<uint64_t>(kvo.tag));
+
+        if (kvo.tag == LLAMA_KV_OVERRIDE_TYPE_STR) {
+            hashBytes(kvo.val_str, strnlen(kvo.val_str, sizeof(kvo.val_str)));
+        } else if (kvo.tag == LLAMA_KV_OVERRIDE_TYPE_INT) {
+            hashValue(static_cast<uint64_t>(kvo.val_i64));
+        } else if (kvo.tag == LLAMA_KV_OVERRIDE_TYPE_FLOAT) {
+            hashBytes(&kvo.val_f64, sizeof(kvo.val_f64));
+        } else if (kvo.tag == LLAMA_KV_OVERRIDE_TYPE_BOOL) {
+            hashValue(static_cast<uint64_t>(kvo.val_bool));
+        }
+    }
+
+    char paramsHash[17];
+    snprintf(paramsHash, sizeof(paramsHash), "%016llx", static_cast<unsigned long long>(hash));
+
+    return canonicalPath + "#" + paramsHash;
+}
+
+Napi::Value AddonModel::GetVocabHash(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // returned as a hex string, so it stays stable when persisted by JS code
+    char hashText[17];
+    snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(getVocabHash()));
+
+    return Napi::String::New(info.Env(), hashText);
+}
+
 void AddonModel::init(Napi::Object exports) {
     exports.Set(
         "AddonModel",
@@ -668,6 +1125,7 @@ void AddonModel::init(Napi::Object exports) {
                 InstanceMethod("loadLora", &AddonModel::LoadLora),
                 InstanceMethod("abortActiveModelLoad", &AddonModel::AbortActiveModelLoad),
                 InstanceMethod("tokenize", &AddonModel::Tokenize),
+                InstanceMethod("tokenizeBatch", &AddonModel::TokenizeBatch),
                 InstanceMethod("detokenize", &AddonModel::Detokenize),
                 InstanceMethod("getTrainContextSize", &AddonModel::GetTrainContextSize),
                 InstanceMethod("getEmbeddingVectorSize", &AddonModel::GetEmbeddingVectorSize),
@@ -689,6 +1147,7 @@ void AddonModel::init(Napi::Object exports) {
                 InstanceMethod("shouldPrependBosToken", &AddonModel::ShouldPrependBosToken),
                 InstanceMethod("shouldAppendEosToken", &AddonModel::ShouldAppendEosToken),
                 InstanceMethod("getModelSize", &AddonModel::GetModelSize),
+                InstanceMethod("getVocabHash", &AddonModel::GetVocabHash),
                 InstanceMethod("dispose", &AddonModel::Dispose),
             }
         )
@@ -8,6 +8,7 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
     public:
         llama_model_params model_params;
         std::vector<llama_model_kv_override> kv_overrides;
+        std::vector<float> tensor_split_values;
         llama_model* model;
         const llama_vocab* vocab;
         uint64_t loadedModelSize = 0;
@@ -16,6 +17,10 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         AddonModelData* data;
 
         std::string modelPath;
+        std::string sharedModelKey;
+        bool attachedToSharedModel = false;
+        bool prefetch = false;
+        float loadProgressScale = 1.0f;
         bool modelLoaded = false;
         bool abortModelLoad = false;
         bool model_load_stopped = false;
@@ -31,11 +36,20 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         ~AddonModel();
         void dispose();
 
+        // stable FNV-1a fingerprint of the vocabulary (token texts + special tokens),
+        // computed once on first use
+        uint64_t getVocabHash();
+
+        // canonical model path + load params fingerprint,
+        // used as the `AddonModelRegistry` key for sharing loaded weights across environments
+        std::string computeSharedModelKey();
+
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value LoadLora(const Napi::CallbackInfo& info);
         Napi::Value AbortActiveModelLoad(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
         Napi::Value Tokenize(const Napi::CallbackInfo& info);
+        Napi::Value TokenizeBatch(const Napi::CallbackInfo& info);
         Napi::Value Detokenize(const Napi::CallbackInfo& info);
         Napi::Value GetTrainContextSize(const Napi::CallbackInfo& info);
         Napi::Value GetEmbeddingVectorSize(const Napi::CallbackInfo& info);
@@ -59,6 +73,11 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         Napi::Value ShouldPrependBosToken(const Napi::CallbackInfo& info);
         Napi::Value ShouldAppendEosToken(const Napi::CallbackInfo& info);
         Napi::Value GetModelSize(const Napi::CallbackInfo& info);
+        Napi::Value GetVocabHash(const Napi::CallbackInfo& info);
 
         static void init(Napi::Object exports);
+
+    private:
+        uint64_t vocabHash = 0;
+        bool vocabHashComputed = false;
 };
@@ -1,13 +1,20 @@
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 #include "addonGlobals.h"
 #include "AddonModelData.h"
 #include "AddonModelLora.h"
 
+static const size_t maxPooledContexts = 4;
+
 AddonModelData::AddonModelData() {
 
 }
 AddonModelData::~AddonModelData() {
+    freePooledContexts();
+
     std::set<AddonModelLora *> currentLoraAdapters;
     currentLoraAdapters.swap(loraAdapters);
 
@@ -22,4 +29,110 @@ void AddonModelData::removeLora(AddonModelLora* lora) {
     if (pos != loraAdapters.end()) {
         loraAdapters.erase(pos);
     }
+}
+
+llama_context* AddonModelData::checkOutContext(uint64_t contextParamsHash) {
+    std::lock_guard<std::mutex> lock(pooledContextsMutex);
+
+    for (auto pos = pooledContexts.begin(); pos != pooledContexts.end(); pos++) {
+        if (pos->first == contextParamsHash) {
+            llama_context* context = pos->second;
+            pooledContexts.erase(pos);
+            return context;
+        }
+    }
+
+    return nullptr;
+}
+
+bool AddonModelData::checkInContext(uint64_t contextParamsHash, llama_context* context) {
+    std::lock_guard<std::mutex> lock(pooledContextsMutex);
+
+    if (pooledContexts.size() >= maxPooledContexts) {
+        return false;
+    }
+
+    pooledContexts.emplace_back(contextParamsHash, context);
+    return true;
+}
+
+void AddonModelData::freePooledContexts() {
+    std::vector<std::pair<uint64_t, llama_context*>> currentPooledContexts;
+
+    {
+        std::lock_guard<std::mutex> lock(pooledContextsMutex);
+        currentPooledContexts.swap(pooledContexts);
+    }
+
+    for (const auto & pooledContext : currentPooledContexts) {
+        llama_free(pooledContext.second);
+    }
+}
+
+struct SharedModelEntry {
+    llama_model* model = nullptr;
+    size_t refCount = 0;
+    bool loading = false;
+};
+
+static std::mutex sharedModelRegistryMutex;
+static std::condition_variable sharedModelRegistryCondition;
+static std::unordered_map<std::string, SharedModelEntry> sharedModelRegistry;
+
+llama_model* AddonModelRegistry::acquireOrBeginLoad(const std::string& key) {
+    std::unique_lock<std::mutex> lock(sharedModelRegistryMutex);
+
+    while (true) {
+        auto pos = sharedModelRegistry.find(key);
+
+        if (pos == sharedModelRegistry.end()) {
+            auto & entry = sharedModelRegistry[key];
+            entry.loading = true;
+            return nullptr;
+        }
+
+        if (pos->second.loading) {
+            sharedModelRegistryCondition.wait(lock);
+            continue;
+        }
+
+        pos->second.refCount++;
+        return pos->second.model;
+    }
+}
+
+void AddonModelRegistry::finishLoad(const std::string& key, llama_model* model) {
+    {
+        std::lock_guard<std::mutex> lock(sharedModelRegistryMutex);
+
+        auto pos = sharedModelRegistry.find(key);
+        if (pos != sharedModelRegistry.end()) {
+            if (model == nullptr) {
+                sharedModelRegistry.erase(pos);
+            } else {
+                pos->second.model = model;
+                pos->second.refCount = 1;
+                pos->second.loading = false;
+            }
+        }
+    }
+
+    sharedModelRegistryCondition.notify_all();
+}
+
+bool AddonModelRegistry::release(const std::string& key) {
+    std::lock_guard<std::mutex> lock(sharedModelRegistryMutex);
+
+    auto pos = sharedModelRegistry.find(key);
+    if (pos == sharedModelRegistry.end()) {
+        return true;
+    }
+
+    if (pos->second.refCount > 1) {
+        pos->second.refCount--;
+        return false;
+    }
+
+    sharedModelRegistry.erase(pos);
+    return true;
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
+#include <mutex>
 #include <set>
+#include <string>
+#include <utility>
+#include <vector>
 #include "llama.h"
 #include "napi.h"
 #include "addonGlobals.h"
@@ -12,4 +16,46 @@ class AddonModelData {
         ~AddonModelData();
 
         void removeLora(AddonModelLora* lora);
+
+        // warm context pool: disposing a poolable context checks its `llama_context`
+        // in here instead of freeing it, so creating a new context with the same params
+        // reuses the existing KV cache allocation instead of paying for a full
+        // `llama_init_from_model`
+
+        // returns a pooled context created with the given params hash,
+        // or `nullptr` when none is available
+        llama_context* checkOutContext(uint64_t contextParamsHash);
+
+        // returns false when the pool is full and the caller should free the context itself
+        bool checkInContext(uint64_t contextParamsHash, llama_context* context);
+
+        // must be called before the model is freed, since pooled contexts reference it
+        void freePooledContexts();
+
+    private:
+        std::mutex pooledContextsMutex;
+        std::vector<std::pair<uint64_t, llama_context*>> pooledContexts;
+};
+
+// process-wide registry of loaded models, keyed by canonical model path + load params.
+// worker_threads each load the addon into their own environment, but they all share the
+// process, and a `llama_model` is thread-safe for inference - so a second load of the
+// same model can reuse the weights that are already in memory instead of mapping
+// and uploading them again
+class AddonModelRegistry {
+    public:
+        // returns an already-loaded model for the key and increments its reference count.
+        // when no model is registered for the key, marks the key as loading and returns
+        // `nullptr` - the caller must load the model itself and call `finishLoad`.
+        // when another thread is currently loading the same key, waits for it to finish
+        static llama_model* acquireOrBeginLoad(const std::string& key);
+
+        // publishes the result of a load started by `acquireOrBeginLoad`.
+        // pass `nullptr` when the load failed or was aborted, so waiting threads
+        // fall back to loading the model themselves
+        static void finishLoad(const std::string& key, llama_model* model);
+
+        // decrements the reference count for the key; returns true when this was the
+        // last reference and the caller should free the model
+        static bool release(const std::string& key);
 };
\ No newline at end of file
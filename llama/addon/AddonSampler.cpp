@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include "common/common.h"
 #include "llama.h"
 
@@ -82,57 +84,108 @@ void AddonSampler::freeChain() {
         llama_sampler_chain_remove(chain, 0);
     }
 
+    chainStages.clear();
     llama_sampler_free(chain);
     chain = nullptr;
 }
 
+void AddonSampler::markChainDirty() {
+    chainDirty = true;
+}
+
+void AddonSampler::detachChainStage(llama_sampler * sampler) {
+    chainDirty = true;
+
+    if (chain == nullptr || sampler == nullptr) {
+        return;
+    }
+
+    // detach the stage from the live chain before it gets freed,
+    // keeping every other stage (and its state) attached
+    for (size_t i = 0; i < chainStages.size(); i++) {
+        if (chainStages[i] == sampler) {
+            llama_sampler_chain_remove(chain, static_cast<int32_t>(i));
+            chainStages.erase(chainStages.begin() + i);
+            break;
+        }
+    }
+}
+
 void AddonSampler::rebuildChainIfNeeded() {
     if (disposed) {
         throw std::runtime_error("Sampler is disposed");
     }
 
-    if (chain != nullptr) {
+    if (chain != nullptr && !chainDirty) {
         return;
     }
 
-    auto sampler_params = llama_sampler_chain_default_params();
-    chain = llama_sampler_chain_init(sampler_params);
+    if (chain == nullptr) {
+        auto sampler_params = llama_sampler_chain_default_params();
+        chain = llama_sampler_chain_init(sampler_params);
+        chainStages.clear();
+    }
+
+    std::vector<llama_sampler *> desiredStages;
+    desiredStages.reserve(8);
 
     if (tokenBiasSampler != nullptr) {
-        llama_sampler_chain_add(chain, tokenBiasSampler);
+        desiredStages.push_back(tokenBiasSampler);
     }
 
     if (repeatPenaltySampler != nullptr) {
-        llama_sampler_chain_add(chain, repeatPenaltySampler);
+        desiredStages.push_back(repeatPenaltySampler);
     }
 
     if (grammarEvaluationState != nullptr) {
-        llama_sampler_chain_add(chain, grammarEvaluationState->sampler);
+        desiredStages.push_back(grammarEvaluationState->sampler);
     }
 
     if (greedySampler != nullptr) {
-        llama_sampler_chain_add(chain, greedySampler);
+        desiredStages.push_back(greedySampler);
     } else {
         if (topKSampler != nullptr) {
-            llama_sampler_chain_add(chain, topKSampler);
+            desiredStages.push_back(topKSampler);
         }
 
         if (topPSampler != nullptr) {
-            llama_sampler_chain_add(chain, topPSampler);
+            desiredStages.push_back(topPSampler);
         }
 
         if (minPSampler != nullptr) {
-            llama_sampler_chain_add(chain, minPSampler);
+            desiredStages.push_back(minPSampler);
         }
 
         if (temperatureSampler != nullptr) {
-            llama_sampler_chain_add(chain, temperatureSampler);
+            desiredStages.push_back(temperatureSampler);
         }
 
         if (seedSampler != nullptr) {
-            llama_sampler_chain_add(chain, seedSampler);
+            desiredStages.push_back(seedSampler);
         }
     }
+
+    // only the suffix of the chain that diverges gets detached and reattached,
+    // so a single stage swap doesn't reconstruct the whole chain
+    size_t firstDivergingStage = 0;
+    while (firstDivergingStage < chainStages.size() &&
+        firstDivergingStage < desiredStages.size() &&
+        chainStages[firstDivergingStage] == desiredStages[firstDivergingStage]
+    ) {
+        firstDivergingStage++;
+    }
+
+    while (chainStages.size() > firstDivergingStage) {
+        llama_sampler_chain_remove(chain, static_cast<int32_t>(chainStages.size() - 1));
+        chainStages.pop_back();
+    }
+
+    for (size_t i = firstDivergingStage; i < desiredStages.size(); i++) {
+        llama_sampler_chain_add(chain, desiredStages[i]);
+        chainStages.push_back(desiredStages[i]);
+    }
+
+    chainDirty = false;
 }
 
 void AddonSampler::acceptToken(llama_token token) {
@@ -143,6 +196,7 @@ void AddonSampler::acceptToken(llama_token token) {
 
     if (grammarEvaluationState != nullptr && grammarEvaluationState->sampler != nullptr && !llama_vocab_is_eog(model->vocab, token)) {
         llama_sampler_accept(grammarEvaluationState->sampler, token);
+        grammarEvaluationState->registerAcceptedToken(token);
     }
 }
 
@@ -166,19 +220,22 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
         if (temperature != temperatureSampler_temperature || !temperatureSampler_initialized) {
             temperatureSampler_initialized = true;
             temperatureSampler_temperature = temperature;
-            freeChain();
 
             if (temperatureSampler != nullptr) {
+                detachChainStage(temperatureSampler);
                 llama_sampler_free(temperatureSampler);
                 temperatureSampler = nullptr;
             }
 
             if (temperatureSampler_temperature <= 0) {
+                markChainDirty();
                 greedySampler = llama_sampler_init_greedy();
             } else {
+                markChainDirty();
                 temperatureSampler = llama_sampler_init_temp(temperatureSampler_temperature);
 
                 if (greedySampler != nullptr) {
+                    detachChainStage(greedySampler);
                     llama_sampler_free(greedySampler);
                     greedySampler = nullptr;
                 }
@@ -186,12 +243,13 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
         }
     } else {
          if (temperatureSampler != nullptr) {
-            freeChain();
+            detachChainStage(temperatureSampler);
             llama_sampler_free(temperatureSampler);
             temperatureSampler = nullptr;
          }
 
         if (greedySampler == nullptr) {
+            markChainDirty();
             greedySampler = llama_sampler_init_greedy();
         }
     }
@@ -200,19 +258,20 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
         auto minP = config.Get("minP").As<Napi::Number>().FloatValue();
         if (minP != minPSampler_minP) {
             minPSampler_minP = minP;
-            freeChain();
 
             if (minPSampler != nullptr) {
+                detachChainStage(minPSampler);
                 llama_sampler_free(minPSampler);
                 minPSampler = nullptr;
             }
 
             if (minPSampler_minP != 0) {
+                markChainDirty();
                 minPSampler = llama_sampler_init_min_p(minPSampler_minP, min_keep);
             }
         }
     } else if (minPSampler != nullptr) {
-        freeChain();
+        detachChainStage(minPSampler);
         llama_sampler_free(minPSampler);
         minPSampler = nullptr;
     }
@@ -222,9 +281,9 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
         if (topK != topKSampler_topK || !topKSampler_initialized) {
             topKSampler_initialized = true;
             topKSampler_topK = topK;
-            freeChain();
 
             if (topKSampler != nullptr) {
+                detachChainStage(topKSampler);
                 llama_sampler_free(topKSampler);
                 topKSampler = nullptr;
             }
@@ -233,10 +292,11 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
                 ? llama_vocab_n_tokens(model->vocab)
                 : std::min(topKSampler_topK, llama_vocab_n_tokens(model->vocab));
 
+            markChainDirty();
             topKSampler = llama_sampler_init_top_k(resolved_top_k);
         }
     } else if (topKSampler != nullptr) {
-        freeChain();
+        detachChainStage(topKSampler);
         llama_sampler_free(topKSampler);
         topKSampler = nullptr;
     }
@@ -245,19 +305,20 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
         auto topP = config.Get("topP").As<Napi::Number>().FloatValue();
         if (topP != topPSampler_topP) {
             topPSampler_topP = topP;
-            freeChain();
 
             if (topPSampler != nullptr) {
+                detachChainStage(topPSampler);
                 llama_sampler_free(topPSampler);
                 topPSampler = nullptr;
             }
 
             if (topPSampler_topP >= 1) {
+                markChainDirty();
                 topPSampler = llama_sampler_init_top_p(topPSampler_topP, min_keep);
             }
         }
     } else if (topPSampler != nullptr) {
-        freeChain();
+        detachChainStage(topPSampler);
         llama_sampler_free(topPSampler);
         topPSampler = nullptr;
     }
@@ -266,21 +327,81 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
         auto seed = config.Get("seed").As<Napi::Number>().Uint32Value();
         if (seed != seedSampler_seed || seedSampler == nullptr) {
             seedSampler_seed = seed;
-            freeChain();
 
             if (seedSampler != nullptr) {
+                detachChainStage(seedSampler);
                 llama_sampler_free(seedSampler);
                 seedSampler = nullptr;
             }
 
+            markChainDirty();
             seedSampler = llama_sampler_init_dist(seedSampler_seed);
         }
     } else if (seedSampler == nullptr) {
-        freeChain();
+        markChainDirty();
         seedSampler = llama_sampler_init_dist(time(NULL));
     }
 
-    if (config.Has("repeatPenaltyTokens")) {
+    if (config.Has("repeatPenaltyNativeTokens") && config.Get("repeatPenaltyNativeTokens").As<Napi::Boolean>().Value()) {
+        // the natively tracked token history is the source of truth:
+        // "acceptToken" and "setTokenHistory" maintain "repeatPenalty_lastTokens",
+        // so there's no token array to receive and diff here
+        auto repeatPenalty = config.Has("repeatPenalty")
+            ? config.Get("repeatPenalty").As<Napi::Number>().FloatValue()
+            : 1;
+        auto repeatPenaltyMaxTokens = config.Has("repeatPenaltyMaxTokens")
+            ? config.Get("repeatPenaltyMaxTokens").As<Napi::Number>().Int32Value()
+            : 64;
+        auto repeatPenaltyPresencePenalty = config.Has("repeatPenaltyPresencePenalty")
+            ? config.Get("repeatPenaltyPresencePenalty").As<Napi::Number>().FloatValue()
+            : 0;
+        auto repeatPenaltyFrequencyPenalty = config.Has("repeatPenaltyFrequencyPenalty")
+            ? config.Get("repeatPenaltyFrequencyPenalty").As<Napi::Number>().FloatValue()
+            : 0;
+
+        auto repeatPenaltyEnabled = repeatPenalty != 1 && repeatPenaltyMaxTokens > 0;
+
+        bool existingSamplerMatchesConfig = repeatPenaltySampler != nullptr;
+        existingSamplerMatchesConfig &= repeatPenalty_maxTokens == repeatPenaltyMaxTokens;
+        existingSamplerMatchesConfig &= repeatPenalty_penalty == repeatPenalty;
+        existingSamplerMatchesConfig &= repeatPenalty_presencePenalty == repeatPenaltyPresencePenalty;
+        existingSamplerMatchesConfig &= repeatPenalty_frequencyPenalty == repeatPenaltyFrequencyPenalty;
+
+        if (!repeatPenaltyEnabled) {
+            if (repeatPenaltySampler != nullptr) {
+                detachChainStage(repeatPenaltySampler);
+                llama_sampler_free(repeatPenaltySampler);
+                repeatPenaltySampler = nullptr;
+            }
+        } else if (!existingSamplerMatchesConfig) {
+            if (repeatPenaltySampler != nullptr) {
+                detachChainStage(repeatPenaltySampler);
+                llama_sampler_free(repeatPenaltySampler);
+                repeatPenaltySampler = nullptr;
+            }
+
+            markChainDirty();
+            repeatPenaltySampler = llama_sampler_init_penalties(
+                repeatPenaltyMaxTokens,
+                repeatPenalty,
+                repeatPenaltyFrequencyPenalty,
+                repeatPenaltyPresencePenalty
+            );
+
+            // re-feed the retained history into the new sampler, oldest token first
+            const auto tokenHistory = repeatPenalty_lastTokens.to_vector();
+            repeatPenalty_lastTokens = RingBuffer<llama_token>(repeatPenaltyMaxTokens);
+            for (const auto token : tokenHistory) {
+                llama_sampler_accept(repeatPenaltySampler, token);
+                repeatPenalty_lastTokens.push_back(token);
+            }
+
+            repeatPenalty_maxTokens = repeatPenaltyMaxTokens;
+            repeatPenalty_penalty = repeatPenalty;
+            repeatPenalty_presencePenalty = repeatPenaltyPresencePenalty;
+            repeatPenalty_frequencyPenalty = repeatPenaltyFrequencyPenalty;
+        }
+    } else if (config.Has("repeatPenaltyTokens")) {
         Napi::Uint32Array repeat_penalty_tokens_uint32_array = config.Get("repeatPenaltyTokens").As<Napi::Uint32Array>();
         auto repeatPenalty = config.Has("repeatPenalty")
             ? config.Get("repeatPenalty").As<Napi::Number>().FloatValue()
@@ -300,12 +421,12 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
 
         if (!repeatPenaltyEnabled) {
             if (repeatPenaltySampler != nullptr) {
-                freeChain();
+                detachChainStage(repeatPenaltySampler);
                 llama_sampler_free(repeatPenaltySampler);
                 repeatPenaltySampler = nullptr;
             }
         } else if (repeatPenaltySampler == nullptr) {
-            freeChain();
+            markChainDirty();
             shouldCreateSampler = true;
         } else {
             bool existingSamplerMatchesConfig = true;
@@ -339,7 +460,7 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
             }
 
             if (!existingSamplerMatchesConfig) {
-                freeChain();
+                detachChainStage(repeatPenaltySampler);
                 llama_sampler_free(repeatPenaltySampler);
                 repeatPenaltySampler = nullptr;
 
@@ -367,7 +488,7 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
             repeatPenalty_frequencyPenalty = repeatPenaltyFrequencyPenalty;
         }
     } else if (repeatPenaltySampler != nullptr) {
-        freeChain();
+        detachChainStage(repeatPenaltySampler);
         llama_sampler_free(repeatPenaltySampler);
         repeatPenaltySampler = nullptr;
     }
@@ -390,11 +511,13 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
 
             if (!existingSamplerMatchesConfig) {
                 if (tokenBiasSampler != nullptr) {
-                    freeChain();
+                    detachChainStage(tokenBiasSampler);
                     llama_sampler_free(tokenBiasSampler);
                     tokenBiasSampler = nullptr;
                 }
 
+                markChainDirty();
+
                 tokenBiasSampler_biases.clear();
                 tokenBiasSampler_biases.reserve(tokenBiasKeys.ElementLength());
 
@@ -409,12 +532,12 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
                 );
             }
         } else if (tokenBiasSampler != nullptr) {
-            freeChain();
+            detachChainStage(tokenBiasSampler);
             llama_sampler_free(tokenBiasSampler);
             tokenBiasSampler = nullptr;
         }
     } else if (tokenBiasSampler != nullptr) {
-        freeChain();
+        detachChainStage(tokenBiasSampler);
         llama_sampler_free(tokenBiasSampler);
         tokenBiasSampler = nullptr;
     }
@@ -424,18 +547,18 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
             Napi::ObjectWrap<AddonGrammarEvaluationState>::Unwrap(config.Get("grammarEvaluationState").As<Napi::Object>());
 
         if (grammarEvaluationState != configGrammarEvaluationState) {
-            freeChain();
-
             if (grammarEvaluationState != nullptr) {
+                detachChainStage(grammarEvaluationState->sampler);
                 grammarEvaluationState->Unref();
                 grammarEvaluationState = nullptr;
             }
 
+            markChainDirty();
             grammarEvaluationState = configGrammarEvaluationState;
             grammarEvaluationState->Ref();
         }
     } else if (grammarEvaluationState != nullptr) {
-        freeChain();
+        detachChainStage(grammarEvaluationState->sampler);
         grammarEvaluationState->Unref();
         grammarEvaluationState = nullptr;
     }
@@ -443,6 +566,36 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
     return info.Env().Undefined();
 }
 
+Napi::Value AddonSampler::SetTokenHistory(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Sampler is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // replaces the natively tracked repeat penalty token history, oldest token first.
+    // meant to be called once at sequence start or after context edits;
+    // "acceptToken" keeps the history up to date between calls
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+
+    repeatPenalty_lastTokens = RingBuffer<llama_token>(repeatPenalty_maxTokens);
+
+    if (repeatPenaltySampler != nullptr) {
+        llama_sampler_reset(repeatPenaltySampler);
+    }
+
+    for (size_t i = 0; i < tokens.ElementLength(); i++) {
+        const auto token = static_cast<llama_token>(tokens[i]);
+
+        if (repeatPenaltySampler != nullptr) {
+            llama_sampler_accept(repeatPenaltySampler, token);
+        }
+
+        repeatPenalty_lastTokens.push_back(token);
+    }
+
+    return info.Env().Undefined();
+}
+
 Napi::Value AddonSampler::AcceptGrammarEvaluationStateToken(const Napi::CallbackInfo& info) {
     AddonGrammarEvaluationState* grammar_evaluation_state =
         Napi::ObjectWrap<AddonGrammarEvaluationState>::Unwrap(info[0].As<Napi::Object>());
@@ -450,10 +603,62 @@ Napi::Value AddonSampler::AcceptGrammarEvaluationStateToken(const Napi::Callback
 
     if ((grammar_evaluation_state)->sampler != nullptr) {
         llama_sampler_accept((grammar_evaluation_state)->sampler, tokenId);
+        (grammar_evaluation_state)->registerAcceptedToken(tokenId);
     }
 
     return info.Env().Undefined();
 }
+Napi::Value AddonSampler::ComputeGrammarMask(const Napi::CallbackInfo& info) {
+    AddonGrammarEvaluationState* grammar_evaluation_state =
+        Napi::ObjectWrap<AddonGrammarEvaluationState>::Unwrap(info[0].As<Napi::Object>());
+
+    const int n_vocab = llama_vocab_n_tokens(grammar_evaluation_state->model->vocab);
+    const size_t maskBytes = (static_cast<size_t>(n_vocab) + 7) / 8;
+
+    Napi::Uint8Array mask = Napi::Uint8Array::New(info.Env(), maskBytes);
+    std::fill(mask.Data(), mask.Data() + maskBytes, 0);
+
+    if ((grammar_evaluation_state)->sampler == nullptr) {
+        return mask;
+    }
+
+    std::vector<uint8_t> cachedMask;
+    if (grammar_evaluation_state->grammarDef->getCachedTokenMask(grammar_evaluation_state->stateHash, cachedMask) &&
+        cachedMask.size() == maskBytes
+    ) {
+        memcpy(mask.Data(), cachedMask.data(), maskBytes);
+        return mask;
+    }
+
+    // apply the grammar sampler over the whole vocabulary in one pass
+    // instead of testing one token per call
+    std::vector<llama_token_data> candidates(n_vocab);
+    for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+        candidates[token_id] = llama_token_data { token_id, 1.0f, 0.0f };
+    }
+
+    llama_token_data_array candidates_p = {
+        /* .data       = */ candidates.data(),
+        /* .size       = */ candidates.size(),
+        /* .selected   = */ -1,
+        /* .sorted     = */ false,
+    };
+
+    llama_sampler_apply((grammar_evaluation_state)->sampler, &candidates_p);
+
+    std::vector<uint8_t> computedMask(maskBytes, 0);
+    for (size_t i = 0; i < candidates_p.size; i++) {
+        if (candidates_p.data[i].logit != -INFINITY) {
+            const auto token_id = candidates_p.data[i].id;
+            computedMask[token_id / 8] = computedMask[token_id / 8] | (1 << (token_id % 8));
+        }
+    }
+
+    grammar_evaluation_state->grammarDef->setCachedTokenMask(grammar_evaluation_state->stateHash, computedMask);
+    memcpy(mask.Data(), computedMask.data(), maskBytes);
+
+    return mask;
+}
 Napi::Value AddonSampler::CanBeNextTokenForGrammarEvaluationState(const Napi::CallbackInfo& info) {
     AddonGrammarEvaluationState* grammar_evaluation_state =
         Napi::ObjectWrap<AddonGrammarEvaluationState>::Unwrap(info[0].As<Napi::Object>());
@@ -486,7 +691,9 @@ void AddonSampler::init(Napi::Object exports) {
             {
                 InstanceMethod("dispose", &AddonSampler::Dispose),
                 InstanceMethod("applyConfig", &AddonSampler::ApplyConfig),
+                InstanceMethod("setTokenHistory", &AddonSampler::SetTokenHistory),
                 StaticMethod("acceptGrammarEvaluationStateToken", &AddonSampler::AcceptGrammarEvaluationStateToken),
+                StaticMethod("computeGrammarMask", &AddonSampler::ComputeGrammarMask),
                 StaticMethod("canBeNextTokenForGrammarEvaluationState", &AddonSampler::CanBeNextTokenForGrammarEvaluationState),
             }
         )
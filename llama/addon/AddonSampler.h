@@ -10,6 +10,11 @@ class AddonSampler : public Napi::ObjectWrap<AddonSampler> {
         AddonModel* model;
         llama_sampler * chain = nullptr;
 
+        // mirrors the samplers currently attached to "chain", in order,
+        // so chain updates only detach and reattach the stages that changed
+        std::vector<llama_sampler *> chainStages;
+        bool chainDirty = false;
+
         llama_sampler * temperatureSampler = nullptr;
         bool temperatureSampler_initialized = false;
         float temperatureSampler_temperature = 0.0f; // 0.0f = disabled
@@ -50,13 +55,17 @@ class AddonSampler : public Napi::ObjectWrap<AddonSampler> {
 
         void dispose();
         void freeChain();
+        void markChainDirty();
+        void detachChainStage(llama_sampler * sampler);
         void rebuildChainIfNeeded();
         void acceptToken(llama_token token);
 
         Napi::Value Dispose(const Napi::CallbackInfo& info);
         Napi::Value ApplyConfig(const Napi::CallbackInfo& info);
+        Napi::Value SetTokenHistory(const Napi::CallbackInfo& info);
 
         static Napi::Value AcceptGrammarEvaluationStateToken(const Napi::CallbackInfo& info);
+        static Napi::Value ComputeGrammarMask(const Napi::CallbackInfo& info);
         static Napi::Value CanBeNextTokenForGrammarEvaluationState(const Napi::CallbackInfo& info);
 
         static void init(Napi::Object exports);
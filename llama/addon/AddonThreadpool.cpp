@@ -0,0 +1,103 @@
+#include "common/common.h"
+#include "llama.h"
+
+#include "addonGlobals.h"
+#include "AddonThreadpool.h"
+
+AddonThreadpool::AddonThreadpool(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonThreadpool>(info) {
+    auto threadpool_params = ggml_threadpool_params_default(std::max(cpu_get_num_math(), 1));
+
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+
+        if (options.Has("threads")) {
+            threadpool_params.n_threads = std::max(options.Get("threads").As<Napi::Number>().Int32Value(), 1);
+        }
+
+        if (options.Has("cpuMask")) {
+            // list of CPU indexes the pool threads are allowed to run on
+            Napi::Array cpuMask = options.Get("cpuMask").As<Napi::Array>();
+
+            for (uint32_t i = 0; i < cpuMask.Length(); i++) {
+                const auto cpuIndex = cpuMask.Get(i).As<Napi::Number>().Int32Value();
+
+                if (cpuIndex >= 0 && cpuIndex < GGML_MAX_N_THREADS) {
+                    threadpool_params.cpumask[cpuIndex] = true;
+                }
+            }
+
+            // an explicit mask is only useful when each thread actually sticks to it
+            threadpool_params.strict_cpu = true;
+        }
+
+        if (options.Has("strictCpu")) {
+            threadpool_params.strict_cpu = options.Get("strictCpu").As<Napi::Boolean>().Value();
+        }
+
+        if (options.Has("priority")) {
+            const auto priority = options.Get("priority").As<Napi::String>().Utf8Value();
+
+            if (priority == "normal") {
+                threadpool_params.prio = GGML_SCHED_PRIO_NORMAL;
+            } else if (priority == "medium") {
+                threadpool_params.prio = GGML_SCHED_PRIO_MEDIUM;
+            } else if (priority == "high") {
+                threadpool_params.prio = GGML_SCHED_PRIO_HIGH;
+            } else if (priority == "realtime") {
+                threadpool_params.prio = GGML_SCHED_PRIO_REALTIME;
+            }
+        }
+
+        if (options.Has("poll")) {
+            threadpool_params.poll = options.Get("poll").As<Napi::Number>().Uint32Value();
+        }
+    }
+
+    threadCount = threadpool_params.n_threads;
+    threadpool = ggml_threadpool_new(&threadpool_params);
+
+    if (threadpool == nullptr) {
+        Napi::Error::New(info.Env(), "Failed to create a threadpool").ThrowAsJavaScriptException();
+    }
+}
+AddonThreadpool::~AddonThreadpool() {
+    dispose();
+}
+void AddonThreadpool::dispose() {
+    if (disposed) {
+        return;
+    }
+
+    disposed = true;
+    if (threadpool != nullptr) {
+        ggml_threadpool_free(threadpool);
+        threadpool = nullptr;
+    }
+}
+
+Napi::Value AddonThreadpool::GetThreadCount(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Threadpool is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), threadCount);
+}
+Napi::Value AddonThreadpool::Dispose(const Napi::CallbackInfo& info) {
+    dispose();
+    return info.Env().Undefined();
+}
+
+void AddonThreadpool::init(Napi::Object exports) {
+    exports.Set(
+        "AddonThreadpool",
+        DefineClass(
+            exports.Env(),
+            "AddonThreadpool",
+            {
+                InstanceMethod("getThreadCount", &AddonThreadpool::GetThreadCount),
+                InstanceMethod("dispose", &AddonThreadpool::Dispose),
+            }
+        )
+    );
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "llama.h"
+#include "ggml-cpu.h"
+#include "napi.h"
+#include "addonGlobals.h"
+
+// a ggml threadpool with an explicit CPU mask and scheduling priority.
+// pinning a pool to the cores of one NUMA node keeps the compute threads
+// next to the memory they touch, instead of letting the OS scheduler
+// migrate them across sockets between decode calls
+class AddonThreadpool : public Napi::ObjectWrap<AddonThreadpool> {
+    public:
+        ggml_threadpool_t threadpool = nullptr;
+        int32_t threadCount = 0;
+
+        bool disposed = false;
+
+        AddonThreadpool(const Napi::CallbackInfo& info);
+        ~AddonThreadpool();
+        void dispose();
+
+        Napi::Value GetThreadCount(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
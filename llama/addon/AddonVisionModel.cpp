@@ -1,4 +1,5 @@
 #include "AddonVisionModel.h"
+#include "globals/embeddingCache.h"
 #include <algorithm>
 #include <cstring>
 #include <stdexcept>
@@ -87,6 +88,81 @@ Napi::Value AddonVisionModel::Dispose(const Napi::CallbackInfo& info) {
     return info.Env().Undefined();
 }
 
+class AddonVisionModelProcessImageWorker : public Napi::AsyncWorker {
+    public:
+        AddonVisionModel* model;
+        const uint8_t* imageData;
+        int width;
+        int height;
+        std::shared_ptr<std::vector<float>> embedding;
+
+        AddonVisionModelProcessImageWorker(const Napi::CallbackInfo& info, AddonVisionModel* model)
+            : Napi::AsyncWorker(info.Env(), "AddonVisionModelProcessImageWorker"),
+              model(model),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            model->Ref();
+
+            // keep a reference to the input typed array instead of copying it;
+            // the backing store stays pinned while this worker holds the reference,
+            // so the pointer is safe to read from the worker thread
+            Napi::Uint8Array imageArray = info[0].As<Napi::Uint8Array>();
+            imageData = imageArray.Data();
+            imageDataRef = Napi::Persistent(info[0]);
+
+            width = info[1].As<Napi::Number>().Int32Value();
+            height = info[2].As<Napi::Number>().Int32Value();
+        }
+        ~AddonVisionModelProcessImageWorker() {
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Reference<Napi::Value> imageDataRef;
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                // key the cache on the decoded pixels plus everything that affects
+                // preprocessing and the embedding - the mmproj determines both
+                const size_t pixelBytes = static_cast<size_t>(width) * static_cast<size_t>(height) * 3;
+                uint64_t cacheKey = embeddingCacheHashBytes(imageData, pixelBytes);
+                cacheKey = embeddingCacheHashBytes(&width, sizeof(width), cacheKey);
+                cacheKey = embeddingCacheHashBytes(&height, sizeof(height), cacheKey);
+                cacheKey = embeddingCacheHashBytes(model->mmprojPath.data(), model->mmprojPath.size(), cacheKey);
+
+                embedding = embeddingCacheGet(cacheKey);
+                if (embedding == nullptr) {
+                    embedding = std::make_shared<std::vector<float>>(model->processImageData(imageData, width, height, 3));
+                    embeddingCachePut(cacheKey, embedding);
+                }
+            } catch (const std::exception& e) {
+                SetError(std::string("Image processing failed: ") + e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"processImageData\"");
+            }
+        }
+        void OnOK() {
+            // hand the embedding over to JS without copying it; the finalizer's
+            // shared_ptr keeps a cached buffer alive even if the cache evicts it
+            auto arrayBuffer = Napi::ArrayBuffer::New(
+                Env(), embedding->data(), embedding->size() * sizeof(float),
+                [](Napi::Env env, void* data, std::shared_ptr<std::vector<float>>* buffer) {
+                    delete buffer;
+                },
+                new std::shared_ptr<std::vector<float>>(embedding)
+            );
+
+            deferred.Resolve(Napi::Float32Array::New(Env(), embedding->size(), arrayBuffer, 0));
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
 Napi::Value AddonVisionModel::ProcessImage(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
@@ -110,23 +186,9 @@ Napi::Value AddonVisionModel::ProcessImage(const Napi::CallbackInfo& info) {
         return env.Null();
     }
 
-    Napi::Uint8Array imageArray = info[0].As<Napi::Uint8Array>();
-    int width = info[1].As<Napi::Number>().Int32Value();
-    int height = info[2].As<Napi::Number>().Int32Value();
-
-    try {
-        std::vector<float> embedding = processImageData(imageArray.Data(), width, height, 3);
-
-        Napi::Float32Array result = Napi::Float32Array::New(env, embedding.size());
-        for (size_t i = 0; i < embedding.size(); i++) {
-            result[i] = embedding[i];
-        }
-
-        return result;
-    } catch (const std::exception& e) {
-        Napi::Error::New(env, std::string("Image processing failed: ") + e.what()).ThrowAsJavaScriptException();
-        return env.Null();
-    }
+    AddonVisionModelProcessImageWorker* worker = new AddonVisionModelProcessImageWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
 }
 
 Napi::Value AddonVisionModel::GetVisionCapabilities(const Napi::CallbackInfo& info) {
@@ -235,17 +297,35 @@ clip_image_u8* AddonVisionModel::loadImageFromData(const uint8_t* data, int widt
     std::vector<uint8_t> rgb;
     const uint8_t* src = data;
 
-    if (channels != 3) {
+    // layout conversion is the hot addon-side loop for large images, so each
+    // channel count gets its own branch-free loop the compiler can vectorize
+    if (channels == 4) {
+        rgb.resize(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; i++) {
+            rgb[i * 3 + 0] = data[i * 4 + 0];
+            rgb[i * 3 + 1] = data[i * 4 + 1];
+            rgb[i * 3 + 2] = data[i * 4 + 2];
+        }
+        src = rgb.data();
+    } else if (channels == 1) {
+        rgb.resize(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; i++) {
+            const uint8_t gray = data[i];
+            rgb[i * 3 + 0] = gray;
+            rgb[i * 3 + 1] = gray;
+            rgb[i * 3 + 2] = gray;
+        }
+        src = rgb.data();
+    } else if (channels != 3) {
         rgb.resize(pixelCount * 3);
         for (size_t i = 0; i < pixelCount; i++) {
             const size_t srcIndex = i * static_cast<size_t>(channels);
             const uint8_t r = data[srcIndex + 0];
             const uint8_t g = channels > 1 ? data[srcIndex + 1] : r;
-            const uint8_t b = channels > 2 ? data[srcIndex + 2] : r;
             const size_t dstIndex = i * 3;
             rgb[dstIndex + 0] = r;
             rgb[dstIndex + 1] = g;
-            rgb[dstIndex + 2] = b;
+            rgb[dstIndex + 2] = channels > 2 ? data[srcIndex + 2] : r;
         }
         src = rgb.data();
     }
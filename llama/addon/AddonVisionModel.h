@@ -40,10 +40,11 @@ class AddonVisionModel : public Napi::ObjectWrap<AddonVisionModel> {
 
         static Napi::Function GetClass(Napi::Env env);
 
+        std::vector<float> processImageData(const uint8_t* imageData, int width, int height, int channels);
+
     private:
         // Internal vision processing methods
         bool loadVisionModel();
-        std::vector<float> processImageData(const uint8_t* imageData, int width, int height, int channels);
         clip_image_u8* loadImageFromData(const uint8_t* data, int width, int height, int channels);
         clip_image_f32_batch* preprocessImage(clip_image_u8* image);
         std::vector<float> encodeImage(clip_image_f32_batch* images, clip_image_f32* referenceImage);
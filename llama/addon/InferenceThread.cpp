@@ -0,0 +1,97 @@
+#include "InferenceThread.h"
+
+struct InferenceThreadCompletion {
+    InferenceThreadTask* task;
+    std::string error;
+};
+
+InferenceThread::InferenceThread(Napi::Env env) {
+    tsfn = Napi::ThreadSafeFunction::New(
+        env,
+        Napi::Function::New(env, [](const Napi::CallbackInfo& info) {}),
+        "InferenceThread",
+        0,
+        1
+    );
+
+    // prevent blocking the main node process from exiting due to active resources
+    tsfn.Unref(env);
+
+    thread = std::thread(&InferenceThread::run, this);
+}
+InferenceThread::~InferenceThread() {
+    stop();
+}
+
+void InferenceThread::submit(InferenceThreadTask* task) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(task);
+    }
+
+    queueCondition.notify_one();
+}
+
+void InferenceThread::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping) {
+            return;
+        }
+
+        stopping = true;
+    }
+
+    queueCondition.notify_one();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    tsfn.Release();
+}
+
+void InferenceThread::run() {
+    while (true) {
+        InferenceThreadTask* task = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]() {
+                return stopping || !queue.empty();
+            });
+
+            if (stopping && queue.empty()) {
+                return;
+            }
+
+            task = queue.front();
+            queue.pop_front();
+        }
+
+        std::string error;
+        try {
+            error = task->work();
+        } catch (const std::exception& e) {
+            error = e.what();
+        } catch(...) {
+            error = "Unknown error when running an inference thread task";
+        }
+
+        auto* completion = new InferenceThreadCompletion { task, std::move(error) };
+        const auto status = tsfn.NonBlockingCall(
+            completion,
+            [](Napi::Env env, Napi::Function jsCallback, InferenceThreadCompletion* data) {
+                data->task->complete(env, data->error);
+
+                delete data->task;
+                delete data;
+            }
+        );
+
+        if (status != napi_ok) {
+            delete task;
+            delete completion;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "napi.h"
+
+struct InferenceThreadTask {
+    // runs on the inference thread. returns an error message, or an empty string on success
+    std::function<std::string()> work;
+
+    // runs on the JS thread after "work" has finished
+    std::function<void(Napi::Env env, const std::string & error)> complete;
+};
+
+// a dedicated thread that runs inference tasks in submission order,
+// so repeated operations on a context don't pay a libuv thread pool scheduling round trip per call
+class InferenceThread {
+    public:
+        InferenceThread(Napi::Env env);
+        ~InferenceThread();
+
+        void submit(InferenceThreadTask* task);
+        void stop();
+
+    private:
+        void run();
+
+        Napi::ThreadSafeFunction tsfn;
+        std::thread thread;
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        std::deque<InferenceThreadTask*> queue;
+        bool stopping = false;
+};
@@ -5,12 +5,19 @@
 #include "AddonGrammarEvaluationState.h"
 #include "AddonSampler.h"
 #include "AddonContext.h"
+#include "AddonThreadpool.h"
+#include "AddonDetokenizerStream.h"
 #include "AddonVisionModel.h"
+#ifdef LLAMA_WHISPER_AVAILABLE
+#include "AddonAudioModel.h"
+#endif
 #include "globals/addonLog.h"
 #include "globals/addonProgress.h"
 #include "globals/getGpuInfo.h"
 #include "globals/getSwapInfo.h"
 #include "globals/getMemoryInfo.h"
+#include "globals/resourceMonitor.h"
+#include "globals/embeddingCache.h"
 #include "stb/stb_image.h"
 
 // Multimodal includes
@@ -457,12 +464,15 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
         Napi::PropertyDescriptor::Function("getConsts", addonGetConsts),
         Napi::PropertyDescriptor::Function("setLogger", setLogger),
         Napi::PropertyDescriptor::Function("setLoggerLogLevel", setLoggerLogLevel),
+        Napi::PropertyDescriptor::Function("getLoggerDroppedLogCount", getLoggerDroppedLogCount),
         Napi::PropertyDescriptor::Function("getGpuVramInfo", getGpuVramInfo),
         Napi::PropertyDescriptor::Function("getGpuDeviceInfo", getGpuDeviceInfo),
         Napi::PropertyDescriptor::Function("getGpuType", getGpuType),
         Napi::PropertyDescriptor::Function("ensureGpuDeviceIsSupported", ensureGpuDeviceIsSupported),
         Napi::PropertyDescriptor::Function("getSwapInfo", getSwapInfo),
         Napi::PropertyDescriptor::Function("getMemoryInfo", getMemoryInfo),
+        Napi::PropertyDescriptor::Function("startResourceMonitor", startResourceMonitor),
+        Napi::PropertyDescriptor::Function("stopResourceMonitor", stopResourceMonitor),
         Napi::PropertyDescriptor::Function("loadBackends", addonLoadBackends),
         Napi::PropertyDescriptor::Function("setNuma", addonSetNuma),
         Napi::PropertyDescriptor::Function("init", addonInit),
@@ -473,22 +483,26 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
         Napi::PropertyDescriptor::Function("processAudio", addonProcessAudio),
         Napi::PropertyDescriptor::Function("decodeImage", addonDecodeImage),
         Napi::PropertyDescriptor::Function("decodeAudio", addonDecodeAudio),
+        Napi::PropertyDescriptor::Function("setEmbeddingCacheSize", setEmbeddingCacheSize),
+        Napi::PropertyDescriptor::Function("getEmbeddingCacheState", getEmbeddingCacheState),
     });
     AddonModel::init(exports);
     AddonModelLora::init(exports);
     AddonGrammar::init(exports);
     AddonGrammarEvaluationState::init(exports);
     AddonContext::init(exports);
+    AddonThreadpool::init(exports);
     AddonSampler::init(exports);
+    AddonDetokenizerStream::init(exports);
 
     // Initialize multimodal classes conditionally
     #ifdef LLAMA_CLIP_AVAILABLE
         exports.Set("AddonVisionModel", AddonVisionModel::GetClass(env));
     #endif
 
-    // #ifdef LLAMA_WHISPER_AVAILABLE
-    //     exports.Set("AddonAudioModel", AddonAudioModel::GetClass(env));
-    // #endif
+    #ifdef LLAMA_WHISPER_AVAILABLE
+        exports.Set("AddonAudioModel", AddonAudioModel::GetClass(env));
+    #endif
 
     llama_log_set(addonLlamaCppLogCallback, nullptr);
 
@@ -7,6 +7,7 @@ class AddonModelData;
 class AddonContext;
 class AddonGrammar;
 class AddonGrammarEvaluationState;
+class AddonThreadpool;
 
 void adjustNapiExternalMemoryAdd(Napi::Env env, uint64_t size);
 void adjustNapiExternalMemorySubtract(Napi::Env env, uint64_t size);
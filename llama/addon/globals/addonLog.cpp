@@ -1,4 +1,7 @@
-#include <sstream>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "addonLog.h"
 
@@ -7,6 +10,22 @@ bool addonJsLoggerCallbackSet = false;
 int addonLoggerLogLevel = 5;
 int addonLastLoggerLogLevel = 6;
 
+struct addon_log_record {
+    int logLevelNumber;
+    std::string text;
+};
+
+// fixed-size ring shared by every thread that logs. when it fills up faster
+// than the JS thread drains it, the oldest records are shed (and counted)
+// instead of blocking the logging thread or growing without bound
+static const size_t logRingCapacity = 1024;
+static std::mutex logRingMutex;
+static std::vector<addon_log_record> logRing;
+static size_t logRingHead = 0;
+static size_t logRingSize = 0;
+static bool logFlushScheduled = false;
+static std::atomic<uint64_t> droppedLogRecordCount(0);
+
 static int addonGetGgmlLogLevelNumber(ggml_log_level level) {
     switch (level) {
         case GGML_LOG_LEVEL_ERROR: return 2;
@@ -20,36 +39,52 @@ static int addonGetGgmlLogLevelNumber(ggml_log_level level) {
     return 1;
 }
 
+static void writeLogRecordToStdStream(int logLevelNumber, const std::string& text) {
+    if (logLevelNumber == 2) {
+        fputs(text.c_str(), stderr);
+        fflush(stderr);
+    } else {
+        fputs(text.c_str(), stdout);
+        fflush(stdout);
+    }
+}
+
 void addonCallJsLogCallback(
-    Napi::Env env, Napi::Function callback, AddonThreadSafeLogCallbackFunctionContext* context, addon_logger_log* data
+    Napi::Env env, Napi::Function callback, AddonThreadSafeLogCallbackFunctionContext* context, void* data
 ) {
-    bool called = false;
-
-    if (env != nullptr && callback != nullptr && addonJsLoggerCallbackSet) {
-        try {
-            callback.Call({
-                Napi::Number::New(env, data->logLevelNumber),
-                Napi::String::New(env, data->stringStream->str()),
-            });
-            called = true;
-        } catch (const Napi::Error& e) {
-            called = false;
+    std::vector<addon_log_record> batch;
+
+    {
+        std::lock_guard<std::mutex> lock(logRingMutex);
+
+        batch.reserve(logRingSize);
+        for (size_t i = 0; i < logRingSize; i++) {
+            batch.push_back(std::move(logRing[(logRingHead + i) % logRingCapacity]));
         }
+
+        logRingHead = 0;
+        logRingSize = 0;
+        logFlushScheduled = false;
     }
 
-    if (!called && data != nullptr) {
-        if (data->logLevelNumber == 2) {
-            fputs(data->stringStream->str().c_str(), stderr);
-            fflush(stderr);
-        } else {
-            fputs(data->stringStream->str().c_str(), stdout);
-            fflush(stdout);
+    for (const auto& record : batch) {
+        bool called = false;
+
+        if (env != nullptr && callback != nullptr && addonJsLoggerCallbackSet) {
+            try {
+                callback.Call({
+                    Napi::Number::New(env, record.logLevelNumber),
+                    Napi::String::New(env, record.text),
+                });
+                called = true;
+            } catch (const Napi::Error& e) {
+                called = false;
+            }
         }
-    }
 
-    if (data != nullptr) {
-        delete data->stringStream;
-        delete data;
+        if (!called) {
+            writeLogRecordToStdStream(record.logLevelNumber, record.text);
+        }
     }
 }
 
@@ -62,34 +97,59 @@ void addonLlamaCppLogCallback(ggml_log_level level, const char* text, void* user
     }
 
     if (addonJsLoggerCallbackSet) {
-        std::stringstream* stringStream = new std::stringstream();
-        if (text != nullptr) {
-            *stringStream << text;
+        bool scheduleFlush = false;
+
+        {
+            std::lock_guard<std::mutex> lock(logRingMutex);
+
+            if (logRing.size() < logRingCapacity) {
+                logRing.resize(logRingCapacity);
+            }
+
+            if (logRingSize == logRingCapacity) {
+                // drop the oldest record to make room for the new one
+                logRingHead = (logRingHead + 1) % logRingCapacity;
+                logRingSize--;
+                droppedLogRecordCount.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            auto& record = logRing[(logRingHead + logRingSize) % logRingCapacity];
+            record.logLevelNumber = logLevelNumber;
+            record.text = text != nullptr ? text : "";
+            logRingSize++;
+
+            // records added while a flush is pending piggyback on it,
+            // so a burst of log lines costs a single queue dispatch
+            if (!logFlushScheduled) {
+                logFlushScheduled = true;
+                scheduleFlush = true;
+            }
         }
 
-        addon_logger_log* data = new addon_logger_log {
-            logLevelNumber,
-            stringStream,
-        };
-
-        auto status = addonThreadSafeLoggerCallback.NonBlockingCall(data);
+        if (!scheduleFlush) {
+            return;
+        }
 
+        auto status = addonThreadSafeLoggerCallback.NonBlockingCall(nullptr);
         if (status == napi_ok) {
             return;
-        } else {
-            delete stringStream;
-            delete data;
         }
+
+        // the flush couldn't be queued; drain the buffered records to the std streams
+        std::lock_guard<std::mutex> lock(logRingMutex);
+        for (size_t i = 0; i < logRingSize; i++) {
+            const auto& record = logRing[(logRingHead + i) % logRingCapacity];
+            writeLogRecordToStdStream(record.logLevelNumber, record.text);
+        }
+
+        logRingHead = 0;
+        logRingSize = 0;
+        logFlushScheduled = false;
+        return;
     }
 
     if (text != nullptr) {
-        if (level == 2) {
-            fputs(text, stderr);
-            fflush(stderr);
-        } else {
-            fputs(text, stdout);
-            fflush(stdout);
-        }
+        writeLogRecordToStdStream(logLevelNumber, std::string(text));
     }
 }
 
@@ -137,3 +197,7 @@ Napi::Value setLoggerLogLevel(const Napi::CallbackInfo& info) {
 
     return info.Env().Undefined();
 }
+
+Napi::Value getLoggerDroppedLogCount(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(droppedLogRecordCount.load(std::memory_order_relaxed)));
+}
@@ -1,22 +1,22 @@
 #pragma once
+#include <cstdint>
 #include "llama.h"
 #include "napi.h"
 
 
-struct addon_logger_log {
-    public:
-        const int logLevelNumber;
-        const std::stringstream* stringStream;
-};
-
 void addonLlamaCppLogCallback(ggml_log_level level, const char* text, void* user_data);
 
+// log records are buffered in a fixed-size ring and flushed to JS in batches
+// through a single ThreadSafeFunction dispatch, so a burst of log lines
+// (e.g. during model load) doesn't queue one microtask per line.
+// the dispatch carries no payload; the JS-thread callback drains the ring
 using AddonThreadSafeLogCallbackFunctionContext = Napi::Reference<Napi::Value>;
 void addonCallJsLogCallback(
-    Napi::Env env, Napi::Function callback, AddonThreadSafeLogCallbackFunctionContext* context, addon_logger_log* data
+    Napi::Env env, Napi::Function callback, AddonThreadSafeLogCallbackFunctionContext* context, void* data
 );
 using AddonThreadSafeLogCallbackFunction =
-    Napi::TypedThreadSafeFunction<AddonThreadSafeLogCallbackFunctionContext, addon_logger_log, addonCallJsLogCallback>;
+    Napi::TypedThreadSafeFunction<AddonThreadSafeLogCallbackFunctionContext, void, addonCallJsLogCallback>;
 
 Napi::Value setLogger(const Napi::CallbackInfo& info);
 Napi::Value setLoggerLogLevel(const Napi::CallbackInfo& info);
+Napi::Value getLoggerDroppedLogCount(const Napi::CallbackInfo& info);
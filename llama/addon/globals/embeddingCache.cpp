@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "embeddingCache.h"
+
+static const uint64_t fnvPrime = 1099511628211ULL;
+
+struct EmbeddingCacheEntry {
+    uint64_t key;
+    std::shared_ptr<std::vector<float>> embedding;
+    size_t byteSize;
+};
+
+static std::mutex embeddingCacheMutex;
+static std::list<EmbeddingCacheEntry> embeddingCacheLru; // front = most recently used
+static std::unordered_map<uint64_t, std::list<EmbeddingCacheEntry>::iterator> embeddingCacheIndex;
+static size_t embeddingCacheUsedBytes = 0;
+static size_t embeddingCacheMaxBytes = 1024 * 1024 * 128;
+static std::atomic<uint64_t> embeddingCacheHitCount(0);
+static std::atomic<uint64_t> embeddingCacheMissCount(0);
+
+uint64_t embeddingCacheHashBytes(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    // FNV-1a folded over 8-byte words; decoded images are megabytes of pixels,
+    // so hashing a word at a time instead of a byte at a time matters here
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(uint64_t));
+        hash ^= word;
+        hash *= fnvPrime;
+    }
+
+    for (; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= fnvPrime;
+    }
+
+    return hash;
+}
+
+// must be called with `embeddingCacheMutex` held
+static void evictEmbeddingCacheEntriesToFit(size_t targetBytes) {
+    while (embeddingCacheUsedBytes > targetBytes && !embeddingCacheLru.empty()) {
+        const auto& oldest = embeddingCacheLru.back();
+        embeddingCacheUsedBytes -= oldest.byteSize;
+        embeddingCacheIndex.erase(oldest.key);
+        embeddingCacheLru.pop_back();
+    }
+}
+
+std::shared_ptr<std::vector<float>> embeddingCacheGet(uint64_t key) {
+    std::lock_guard<std::mutex> lock(embeddingCacheMutex);
+
+    auto indexEntry = embeddingCacheIndex.find(key);
+    if (indexEntry == embeddingCacheIndex.end()) {
+        embeddingCacheMissCount.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    embeddingCacheLru.splice(embeddingCacheLru.begin(), embeddingCacheLru, indexEntry->second);
+    embeddingCacheHitCount.fetch_add(1, std::memory_order_relaxed);
+    return indexEntry->second->embedding;
+}
+
+void embeddingCachePut(uint64_t key, std::shared_ptr<std::vector<float>> embedding) {
+    if (embedding == nullptr) {
+        return;
+    }
+
+    const size_t byteSize = embedding->size() * sizeof(float);
+
+    std::lock_guard<std::mutex> lock(embeddingCacheMutex);
+
+    if (byteSize > embeddingCacheMaxBytes || embeddingCacheIndex.count(key) != 0) {
+        return;
+    }
+
+    evictEmbeddingCacheEntriesToFit(embeddingCacheMaxBytes - byteSize);
+
+    embeddingCacheLru.push_front({key, std::move(embedding), byteSize});
+    embeddingCacheIndex[key] = embeddingCacheLru.begin();
+    embeddingCacheUsedBytes += byteSize;
+}
+
+Napi::Value setEmbeddingCacheSize(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(info.Env(), "Expected a cache size in bytes").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const auto maxBytes = std::max<int64_t>(info[0].As<Napi::Number>().Int64Value(), 0);
+
+    std::lock_guard<std::mutex> lock(embeddingCacheMutex);
+    embeddingCacheMaxBytes = static_cast<size_t>(maxBytes);
+    evictEmbeddingCacheEntriesToFit(embeddingCacheMaxBytes);
+
+    return info.Env().Undefined();
+}
+
+Napi::Value getEmbeddingCacheState(const Napi::CallbackInfo& info) {
+    uint64_t entryCount = 0;
+    uint64_t usedSize = 0;
+    uint64_t maxSize = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(embeddingCacheMutex);
+        entryCount = embeddingCacheLru.size();
+        usedSize = embeddingCacheUsedBytes;
+        maxSize = embeddingCacheMaxBytes;
+    }
+
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("hitCount", Napi::Number::From(info.Env(), embeddingCacheHitCount.load(std::memory_order_relaxed)));
+    result.Set("missCount", Napi::Number::From(info.Env(), embeddingCacheMissCount.load(std::memory_order_relaxed)));
+    result.Set("entryCount", Napi::Number::From(info.Env(), entryCount));
+    result.Set("usedSize", Napi::Number::From(info.Env(), usedSize));
+    result.Set("maxSize", Napi::Number::From(info.Env(), maxSize));
+
+    return result;
+}
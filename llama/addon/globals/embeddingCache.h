@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "napi.h"
+
+// process-wide LRU cache for multimodal embeddings, keyed by a content hash
+// of the decoded input plus the preprocessing parameters.
+// it's shared by every model instance in the process, so worker_threads
+// sharing a vision model also share the cached embeddings.
+// entries are reference-counted; an evicted entry stays alive for as long as
+// JS still holds a typed array backed by it
+
+uint64_t embeddingCacheHashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+// returns nullptr on a cache miss
+std::shared_ptr<std::vector<float>> embeddingCacheGet(uint64_t key);
+void embeddingCachePut(uint64_t key, std::shared_ptr<std::vector<float>> embedding);
+
+Napi::Value setEmbeddingCacheSize(const Napi::CallbackInfo& info);
+Napi::Value getEmbeddingCacheState(const Napi::CallbackInfo& info);
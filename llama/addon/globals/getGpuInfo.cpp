@@ -1,5 +1,6 @@
 #include "getGpuInfo.h"
 #include "addonLog.h"
+#include "resourceMonitor.h"
 
 #ifdef __APPLE__
     #include <TargetConditionals.h>
@@ -16,14 +17,15 @@ void logVulkanWarning(const char* message) {
 }
 #endif
 
-Napi::Value getGpuVramInfo(const Napi::CallbackInfo& info) {
+void sampleGpuVram(GpuVramSample& sample) {
     ggml_backend_dev_t device = NULL;
     size_t deviceTotal = 0;
     size_t deviceFree = 0;
 
-    uint64_t total = 0;
-    uint64_t used = 0;
-    uint64_t unifiedVramSize = 0;
+    sample.total = 0;
+    sample.used = 0;
+    sample.unifiedSize = 0;
+    sample.devices.clear();
 
     for (size_t i = 0; i < ggml_backend_dev_count(); i++) {
         device = ggml_backend_dev_get(i);
@@ -32,12 +34,18 @@ Napi::Value getGpuVramInfo(const Napi::CallbackInfo& info) {
             deviceFree = 0;
             ggml_backend_dev_memory(device, &deviceFree, &deviceTotal);
 
-            total += deviceTotal;
-            used += deviceTotal - deviceFree;
+            sample.total += deviceTotal;
+            sample.used += deviceTotal - deviceFree;
+
+            sample.devices.push_back({
+                std::string(ggml_backend_dev_name(device)),
+                deviceTotal,
+                deviceTotal - deviceFree
+            });
 
 #if defined(__arm64__) || defined(__aarch64__)
             if (std::string(ggml_backend_dev_name(device)) == "Metal") {
-                unifiedVramSize += deviceTotal;
+                sample.unifiedSize += deviceTotal;
             }
 #endif
         }
@@ -50,23 +58,47 @@ Napi::Value getGpuVramInfo(const Napi::CallbackInfo& info) {
     const bool vulkanDeviceSupportsMemoryBudgetExtension = gpuInfoGetTotalVulkanDevicesInfo(&vulkanDeviceTotal, &vulkanDeviceUsed, &vulkanDeviceUnifiedVramSize, logVulkanWarning);
 
     if (vulkanDeviceSupportsMemoryBudgetExtension) {
-        if (vulkanDeviceUnifiedVramSize > total) {
+        if (vulkanDeviceUnifiedVramSize > sample.total) {
             // this means that we counted memory from devices that aren't used by llama.cpp
             vulkanDeviceUnifiedVramSize = 0;
         }
 
-        unifiedVramSize += vulkanDeviceUnifiedVramSize;
+        sample.unifiedSize += vulkanDeviceUnifiedVramSize;
     }
 
-    if (used == 0 && vulkanDeviceUsed != 0) {
-        used = vulkanDeviceUsed;
+    if (sample.used == 0 && vulkanDeviceUsed != 0) {
+        sample.used = vulkanDeviceUsed;
     }
 #endif
+}
+
+Napi::Value getGpuVramInfo(const Napi::CallbackInfo& info) {
+    GpuVramSample sample;
+    double ageMs = 0;
+
+    // the resource monitor serves a cached reading when it's running,
+    // so admission-control polling doesn't pay for GPU API round trips on every call
+    if (!getCachedGpuVram(sample, ageMs)) {
+        sampleGpuVram(sample);
+    }
+
+    // per-device breakdown alongside the aggregated numbers,
+    // so layer placement can be balanced across multiple GPUs
+    Napi::Array devices = Napi::Array::New(info.Env(), sample.devices.size());
+    for (size_t i = 0; i < sample.devices.size(); i++) {
+        Napi::Object deviceVramInfo = Napi::Object::New(info.Env());
+        deviceVramInfo.Set("name", Napi::String::New(info.Env(), sample.devices[i].name));
+        deviceVramInfo.Set("total", Napi::Number::From(info.Env(), sample.devices[i].total));
+        deviceVramInfo.Set("used", Napi::Number::From(info.Env(), sample.devices[i].used));
+        devices[i] = deviceVramInfo;
+    }
 
     Napi::Object result = Napi::Object::New(info.Env());
-    result.Set("total", Napi::Number::From(info.Env(), total));
-    result.Set("used", Napi::Number::From(info.Env(), used));
-    result.Set("unifiedSize", Napi::Number::From(info.Env(), unifiedVramSize));
+    result.Set("total", Napi::Number::From(info.Env(), sample.total));
+    result.Set("used", Napi::Number::From(info.Env(), sample.used));
+    result.Set("unifiedSize", Napi::Number::From(info.Env(), sample.unifiedSize));
+    result.Set("devices", devices);
+    result.Set("ageMs", Napi::Number::New(info.Env(), ageMs));
 
     return result;
 }
@@ -74,11 +106,28 @@ Napi::Value getGpuVramInfo(const Napi::CallbackInfo& info) {
 Napi::Value getGpuDeviceInfo(const Napi::CallbackInfo& info) {
     std::vector<std::string> deviceNames;
 
+    Napi::Array devices = Napi::Array::New(info.Env());
+    uint32_t deviceCount = 0;
+
     for (size_t i = 0; i < ggml_backend_dev_count(); i++) {
         ggml_backend_dev_t device = ggml_backend_dev_get(i);
         if (ggml_backend_dev_type(device) == GGML_BACKEND_DEVICE_TYPE_GPU) {
 
             deviceNames.push_back(std::string(ggml_backend_dev_description(device)));
+
+            size_t deviceTotal = 0;
+            size_t deviceFree = 0;
+            ggml_backend_dev_memory(device, &deviceFree, &deviceTotal);
+
+            // the device index matches the order llama.cpp assigns GPUs,
+            // so it can be used for the "mainGpu" and "tensorSplit" model options
+            Napi::Object deviceInfo = Napi::Object::New(info.Env());
+            deviceInfo.Set("index", Napi::Number::From(info.Env(), deviceCount));
+            deviceInfo.Set("name", Napi::String::New(info.Env(), ggml_backend_dev_name(device)));
+            deviceInfo.Set("description", Napi::String::New(info.Env(), ggml_backend_dev_description(device)));
+            deviceInfo.Set("totalMemory", Napi::Number::From(info.Env(), deviceTotal));
+            deviceInfo.Set("freeMemory", Napi::Number::From(info.Env(), deviceFree));
+            devices[deviceCount++] = deviceInfo;
         }
     }
 
@@ -89,6 +138,7 @@ Napi::Value getGpuDeviceInfo(const Napi::CallbackInfo& info) {
         deviceNamesNapiArray[i] = Napi::String::New(info.Env(), deviceNames[i]);
     }
     result.Set("deviceNames", deviceNamesNapiArray);
+    result.Set("devices", devices);
 
     return result;
 }
@@ -1,9 +1,26 @@
 #pragma once
 #include <utility>
 #include <string>
+#include <vector>
 #include "napi.h"
 #include "llama.h"
 
+struct GpuVramSample {
+    struct Device {
+        std::string name;
+        uint64_t total = 0;
+        uint64_t used = 0;
+    };
+
+    uint64_t total = 0;
+    uint64_t used = 0;
+    uint64_t unifiedSize = 0;
+    std::vector<Device> devices;
+};
+
+// reads the current VRAM usage of all GPU devices; safe to call from any thread
+void sampleGpuVram(GpuVramSample& sample);
+
 Napi::Value getGpuVramInfo(const Napi::CallbackInfo& info);
 Napi::Value getGpuDeviceInfo(const Napi::CallbackInfo& info);
 std::pair<ggml_backend_dev_t, std::string> getGpuDevice();
@@ -1,5 +1,6 @@
 #include "getMemoryInfo.h"
 #include "addonLog.h"
+#include "resourceMonitor.h"
 
 #ifdef __APPLE__
 #include <iostream>
@@ -16,7 +17,7 @@
 #endif
 
 
-Napi::Value getMemoryInfo(const Napi::CallbackInfo& info) {
+uint64_t sampleMemoryUsage() {
     uint64_t totalMemoryUsage = 0;
 
 #ifdef __APPLE__
@@ -56,8 +57,22 @@ Napi::Value getMemoryInfo(const Napi::CallbackInfo& info) {
         addonLlamaCppLogCallback(GGML_LOG_LEVEL_ERROR, std::string("Failed to get memory usage info").c_str(), nullptr);
     }
 #endif
-    
+
+    return totalMemoryUsage;
+}
+
+Napi::Value getMemoryInfo(const Napi::CallbackInfo& info) {
+    uint64_t totalMemoryUsage = 0;
+    double ageMs = 0;
+
+    // the resource monitor serves a cached reading when it's running,
+    // so admission-control polling doesn't pay for a syscall on every call
+    if (!getCachedMemoryUsage(totalMemoryUsage, ageMs)) {
+        totalMemoryUsage = sampleMemoryUsage();
+    }
+
     Napi::Object obj = Napi::Object::New(info.Env());
     obj.Set("total", Napi::Number::New(info.Env(), totalMemoryUsage));
+    obj.Set("ageMs", Napi::Number::New(info.Env(), ageMs));
     return obj;
 }
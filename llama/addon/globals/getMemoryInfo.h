@@ -1,4 +1,8 @@
 #pragma once
+#include <cstdint>
 #include "napi.h"
 
+// reads the current process memory usage; safe to call from any thread
+uint64_t sampleMemoryUsage();
+
 Napi::Value getMemoryInfo(const Napi::CallbackInfo& info);
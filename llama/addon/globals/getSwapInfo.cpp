@@ -1,5 +1,6 @@
 #include "getSwapInfo.h"
 #include "addonLog.h"
+#include "resourceMonitor.h"
 
 #ifdef __APPLE__
 #include <iostream>
@@ -15,9 +16,9 @@
 #endif
 
 
-Napi::Value getSwapInfo(const Napi::CallbackInfo& info) {
-    uint64_t totalSwap = 0;
-    uint64_t freeSwap = 0;
+void sampleSwapInfo(uint64_t& totalSwap, uint64_t& freeSwap, int64_t& maxSizeResult) {
+    totalSwap = 0;
+    freeSwap = 0;
     uint64_t maxSize = 0;
     bool maxSizeSet = true;
 
@@ -60,10 +61,26 @@ Napi::Value getSwapInfo(const Napi::CallbackInfo& info) {
         addonLlamaCppLogCallback(GGML_LOG_LEVEL_ERROR, std::string("Failed to get pagefile info").c_str(), nullptr);
     }
 #endif
-    
+
+    maxSizeResult = maxSizeSet ? static_cast<int64_t>(maxSize) : -1;
+}
+
+Napi::Value getSwapInfo(const Napi::CallbackInfo& info) {
+    uint64_t totalSwap = 0;
+    uint64_t freeSwap = 0;
+    int64_t maxSize = -1;
+    double ageMs = 0;
+
+    // the resource monitor serves a cached reading when it's running,
+    // so admission-control polling doesn't pay for a syscall on every call
+    if (!getCachedSwapInfo(totalSwap, freeSwap, maxSize, ageMs)) {
+        sampleSwapInfo(totalSwap, freeSwap, maxSize);
+    }
+
     Napi::Object obj = Napi::Object::New(info.Env());
     obj.Set("total", Napi::Number::New(info.Env(), totalSwap));
     obj.Set("free", Napi::Number::New(info.Env(), freeSwap));
-    obj.Set("maxSize", maxSizeSet ? Napi::Number::New(info.Env(), maxSize) : Napi::Number::New(info.Env(), -1));
+    obj.Set("maxSize", Napi::Number::New(info.Env(), maxSize));
+    obj.Set("ageMs", Napi::Number::New(info.Env(), ageMs));
     return obj;
 }
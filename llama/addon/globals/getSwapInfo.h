@@ -1,4 +1,9 @@
 #pragma once
+#include <cstdint>
 #include "napi.h"
 
+// reads the current swap usage; `maxSize` is set to -1 when the platform
+// has no fixed upper bound. safe to call from any thread
+void sampleSwapInfo(uint64_t& totalSwap, uint64_t& freeSwap, int64_t& maxSize);
+
 Napi::Value getSwapInfo(const Napi::CallbackInfo& info);
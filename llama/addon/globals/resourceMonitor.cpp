@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "resourceMonitor.h"
+#include "getMemoryInfo.h"
+#include "getSwapInfo.h"
+#include "getGpuInfo.h"
+
+struct ResourceSnapshot {
+    uint64_t memoryUsage = 0;
+    uint64_t swapTotal = 0;
+    uint64_t swapFree = 0;
+    int64_t swapMaxSize = -1;
+    GpuVramSample gpuVram;
+    std::chrono::steady_clock::time_point sampledAt;
+};
+
+struct resource_monitor_event {
+    std::string resource;
+    bool exceeded;
+    uint64_t value;
+    uint64_t threshold;
+};
+
+using AddonThreadSafeResourceEventCallbackFunctionContext = Napi::Reference<Napi::Value>;
+static void addonCallJsResourceEventCallback(
+    Napi::Env env, Napi::Function callback, AddonThreadSafeResourceEventCallbackFunctionContext* context, resource_monitor_event* data
+) {
+    if (env != nullptr && callback != nullptr && data != nullptr) {
+        try {
+            callback.Call({
+                Napi::String::New(env, data->resource),
+                Napi::Boolean::New(env, data->exceeded),
+                Napi::Number::New(env, data->value),
+                Napi::Number::New(env, data->threshold),
+            });
+        } catch (const Napi::Error& e) {}
+    }
+
+    if (data != nullptr) {
+        delete data;
+    }
+}
+using AddonThreadSafeResourceEventCallbackFunction =
+    Napi::TypedThreadSafeFunction<AddonThreadSafeResourceEventCallbackFunctionContext, resource_monitor_event, addonCallJsResourceEventCallback>;
+
+static std::mutex monitorMutex;
+static std::condition_variable monitorCondition;
+static std::thread monitorThread;
+static bool monitorRunning = false;
+static uint64_t monitorIntervalMs = 1000;
+static std::shared_ptr<ResourceSnapshot> latestSnapshot;
+
+// usage thresholds in bytes; 0 disables the threshold.
+// the `*ThresholdExceeded` flags track edge crossings, so the callback
+// fires once per crossing instead of on every refresh
+static uint64_t memoryUsageThreshold = 0;
+static uint64_t swapUsedThreshold = 0;
+static uint64_t vramUsedThreshold = 0;
+static bool memoryThresholdExceeded = false;
+static bool swapThresholdExceeded = false;
+static bool vramThresholdExceeded = false;
+
+static AddonThreadSafeResourceEventCallbackFunction thresholdEventCallback;
+static bool thresholdEventCallbackSet = false;
+
+static double snapshotAgeMs(const ResourceSnapshot& snapshot) {
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+        std::chrono::steady_clock::now() - snapshot.sampledAt
+    ).count();
+}
+
+bool getCachedMemoryUsage(uint64_t& totalMemoryUsage, double& ageMs) {
+    std::lock_guard<std::mutex> lock(monitorMutex);
+
+    if (!monitorRunning || latestSnapshot == nullptr) {
+        return false;
+    }
+
+    totalMemoryUsage = latestSnapshot->memoryUsage;
+    ageMs = snapshotAgeMs(*latestSnapshot);
+    return true;
+}
+bool getCachedSwapInfo(uint64_t& totalSwap, uint64_t& freeSwap, int64_t& maxSize, double& ageMs) {
+    std::lock_guard<std::mutex> lock(monitorMutex);
+
+    if (!monitorRunning || latestSnapshot == nullptr) {
+        return false;
+    }
+
+    totalSwap = latestSnapshot->swapTotal;
+    freeSwap = latestSnapshot->swapFree;
+    maxSize = latestSnapshot->swapMaxSize;
+    ageMs = snapshotAgeMs(*latestSnapshot);
+    return true;
+}
+bool getCachedGpuVram(GpuVramSample& sample, double& ageMs) {
+    std::lock_guard<std::mutex> lock(monitorMutex);
+
+    if (!monitorRunning || latestSnapshot == nullptr) {
+        return false;
+    }
+
+    sample = latestSnapshot->gpuVram;
+    ageMs = snapshotAgeMs(*latestSnapshot);
+    return true;
+}
+
+// must be called with `monitorMutex` held
+static void checkThresholdCrossing(const char* resource, uint64_t value, uint64_t threshold, bool& thresholdExceeded) {
+    if (threshold == 0 || !thresholdEventCallbackSet) {
+        return;
+    }
+
+    const bool exceeded = value >= threshold;
+    if (exceeded == thresholdExceeded) {
+        return;
+    }
+
+    thresholdExceeded = exceeded;
+
+    resource_monitor_event* event = new resource_monitor_event {
+        std::string(resource),
+        exceeded,
+        value,
+        threshold,
+    };
+
+    auto status = thresholdEventCallback.NonBlockingCall(event);
+    if (status != napi_ok) {
+        delete event;
+    }
+}
+
+static void monitorLoop() {
+    std::unique_lock<std::mutex> lock(monitorMutex);
+
+    while (monitorRunning) {
+        lock.unlock();
+
+        // sampling happens without the lock held,
+        // so readers are never blocked behind a syscall or a GPU API round trip
+        auto snapshot = std::make_shared<ResourceSnapshot>();
+        snapshot->memoryUsage = sampleMemoryUsage();
+        sampleSwapInfo(snapshot->swapTotal, snapshot->swapFree, snapshot->swapMaxSize);
+        sampleGpuVram(snapshot->gpuVram);
+        snapshot->sampledAt = std::chrono::steady_clock::now();
+
+        lock.lock();
+        latestSnapshot = snapshot;
+
+        checkThresholdCrossing("memory", snapshot->memoryUsage, memoryUsageThreshold, memoryThresholdExceeded);
+        checkThresholdCrossing("swap", snapshot->swapTotal - snapshot->swapFree, swapUsedThreshold, swapThresholdExceeded);
+        checkThresholdCrossing("vram", snapshot->gpuVram.used, vramUsedThreshold, vramThresholdExceeded);
+
+        if (monitorRunning) {
+            monitorCondition.wait_for(lock, std::chrono::milliseconds(monitorIntervalMs));
+        }
+    }
+}
+
+static void stopMonitorThread() {
+    {
+        std::lock_guard<std::mutex> lock(monitorMutex);
+
+        if (!monitorRunning) {
+            return;
+        }
+
+        monitorRunning = false;
+    }
+
+    monitorCondition.notify_all();
+    if (monitorThread.joinable()) {
+        monitorThread.join();
+    }
+}
+
+Napi::Value startResourceMonitor(const Napi::CallbackInfo& info) {
+    // restart with the new config when already running
+    stopMonitorThread();
+
+    uint64_t intervalMs = 1000;
+    uint64_t newMemoryUsageThreshold = 0;
+    uint64_t newSwapUsedThreshold = 0;
+    uint64_t newVramUsedThreshold = 0;
+
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+
+        if (options.Has("intervalMs")) {
+            intervalMs = std::max<int64_t>(options.Get("intervalMs").As<Napi::Number>().Int64Value(), 1);
+        }
+
+        if (options.Has("memoryUsageThreshold")) {
+            newMemoryUsageThreshold = static_cast<uint64_t>(options.Get("memoryUsageThreshold").As<Napi::Number>().Int64Value());
+        }
+
+        if (options.Has("swapUsedThreshold")) {
+            newSwapUsedThreshold = static_cast<uint64_t>(options.Get("swapUsedThreshold").As<Napi::Number>().Int64Value());
+        }
+
+        if (options.Has("vramUsedThreshold")) {
+            newVramUsedThreshold = static_cast<uint64_t>(options.Get("vramUsedThreshold").As<Napi::Number>().Int64Value());
+        }
+    }
+
+    if (thresholdEventCallbackSet) {
+        thresholdEventCallbackSet = false;
+        thresholdEventCallback.Release();
+    }
+
+    if (info.Length() > 1 && info[1].IsFunction()) {
+        auto thresholdEventJSCallback = info[1].As<Napi::Function>();
+        AddonThreadSafeResourceEventCallbackFunctionContext* context = new Napi::Reference<Napi::Value>(Napi::Persistent(info.This()));
+        thresholdEventCallback = AddonThreadSafeResourceEventCallbackFunction::New(
+            info.Env(),
+            thresholdEventJSCallback,
+            "resourceMonitorThresholdCallback",
+            0,
+            1,
+            context,
+            [](Napi::Env, void*, AddonThreadSafeResourceEventCallbackFunctionContext* ctx) {
+                delete ctx;
+            }
+        );
+        thresholdEventCallbackSet = true;
+
+        // prevent blocking the main node process from exiting due to active resources
+        thresholdEventCallback.Unref(info.Env());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(monitorMutex);
+
+        monitorIntervalMs = intervalMs;
+        memoryUsageThreshold = newMemoryUsageThreshold;
+        swapUsedThreshold = newSwapUsedThreshold;
+        vramUsedThreshold = newVramUsedThreshold;
+        memoryThresholdExceeded = false;
+        swapThresholdExceeded = false;
+        vramThresholdExceeded = false;
+        latestSnapshot = nullptr;
+        monitorRunning = true;
+    }
+
+    monitorThread = std::thread(monitorLoop);
+
+    return info.Env().Undefined();
+}
+
+Napi::Value stopResourceMonitor(const Napi::CallbackInfo& info) {
+    stopMonitorThread();
+
+    if (thresholdEventCallbackSet) {
+        thresholdEventCallbackSet = false;
+        thresholdEventCallback.Release();
+    }
+
+    return info.Env().Undefined();
+}
+
+// defined last in this translation unit, so it's destroyed before the statics
+// it depends on - stops the monitor thread when the process unloads the addon
+static struct ResourceMonitorShutdown {
+    ~ResourceMonitorShutdown() {
+        stopMonitorThread();
+    }
+} resourceMonitorShutdown;
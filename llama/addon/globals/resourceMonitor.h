@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include "napi.h"
+#include "getGpuInfo.h"
+
+// background thread that refreshes memory, swap and per-device VRAM readings
+// at a configurable interval. while it runs, getMemoryInfo/getSwapInfo/getGpuVramInfo
+// return the cached snapshot (plus its age) instead of querying the system,
+// and an optional callback fires when a configured usage threshold is crossed
+
+// cached snapshot accessors; return false when the monitor isn't running,
+// in which case the caller should sample synchronously
+bool getCachedMemoryUsage(uint64_t& totalMemoryUsage, double& ageMs);
+bool getCachedSwapInfo(uint64_t& totalSwap, uint64_t& freeSwap, int64_t& maxSize, double& ageMs);
+bool getCachedGpuVram(GpuVramSample& sample, double& ageMs);
+
+Napi::Value startResourceMonitor(const Napi::CallbackInfo& info);
+Napi::Value stopResourceMonitor(const Napi::CallbackInfo& info);
@@ -0,0 +1,224 @@
+// Microbenchmark harness for the addon's C++-side hot paths.
+//
+// The benchmarked loops mirror the code the addon runs per token or per batch
+// (candidate-array fill + sampler chain application, batch marshaling,
+// detokenization streaming, state serialization), isolated from Node-API so
+// regressions can be caught by diffing runs across llama.cpp submodule bumps.
+//
+// Usage: llama-addon-bench [modelPath]
+// Model-dependent benchmarks (detokenize, state save/load) are skipped when
+// no model path is given. Results are emitted as JSON on stdout.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "llama.h"
+
+static double elapsedMs(const std::chrono::steady_clock::time_point startTime) {
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+        std::chrono::steady_clock::now() - startTime
+    ).count();
+}
+
+struct BenchResult {
+    std::string name;
+    std::string params;
+    uint64_t iterations;
+    double totalMs;
+};
+
+static std::vector<BenchResult> results;
+
+static void report(const std::string & name, const std::string & params, uint64_t iterations, double totalMs) {
+    results.push_back({name, params, iterations, totalMs});
+    fprintf(stderr, "%s (%s): %llu iterations, %.3fms total, %.6fms/op\n",
+        name.c_str(), params.c_str(), (unsigned long long)iterations, totalMs, totalMs / iterations);
+}
+
+// mirrors AddonContextSampleTokenWorker::SampleToken - fill the candidate array
+// from raw logits and run the sampler chain over it
+static void benchSamplerApply(const int vocabSize) {
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution(0.0f, 4.0f);
+
+    std::vector<float> logits(vocabSize);
+    for (auto & logit : logits) {
+        logit = distribution(generator);
+    }
+
+    auto chainParams = llama_sampler_chain_default_params();
+    chainParams.no_perf = true;
+    auto * chain = llama_sampler_chain_init(chainParams);
+    llama_sampler_chain_add(chain, llama_sampler_init_top_k(40));
+    llama_sampler_chain_add(chain, llama_sampler_init_top_p(0.95f, 1));
+    llama_sampler_chain_add(chain, llama_sampler_init_temp(0.8f));
+    llama_sampler_chain_add(chain, llama_sampler_init_dist(42));
+
+    std::vector<llama_token_data> candidates(vocabSize);
+
+    const uint64_t iterations = 1000;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        for (llama_token token_id = 0; token_id < vocabSize; token_id++) {
+            candidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+        }
+
+        llama_token_data_array cur_p = {
+            /* .data       = */ candidates.data(),
+            /* .size       = */ candidates.size(),
+            /* .selected   = */ -1,
+            /* .sorted     = */ false,
+        };
+
+        llama_sampler_apply(chain, &cur_p);
+        llama_sampler_reset(chain);
+    }
+
+    report("candidateFillAndSamplerApply", "vocabSize=" + std::to_string(vocabSize), iterations, elapsedMs(startTime));
+
+    llama_sampler_free(chain);
+}
+
+// mirrors AddToBatch - marshal tokens into a llama_batch across several sequences
+static void benchBatchAdd(const int sequenceCount) {
+    const int tokensPerSequence = 512;
+    const int totalTokens = tokensPerSequence * sequenceCount;
+
+    llama_batch batch = llama_batch_init(totalTokens, 0, 1);
+
+    const uint64_t iterations = 1000;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        common_batch_clear(batch);
+
+        for (int sequenceId = 0; sequenceId < sequenceCount; sequenceId++) {
+            for (int tokenIndex = 0; tokenIndex < tokensPerSequence; tokenIndex++) {
+                common_batch_add(batch, tokenIndex % 32000, tokenIndex, { sequenceId }, tokenIndex == tokensPerSequence - 1);
+            }
+        }
+    }
+
+    report("batchAdd", "sequences=" + std::to_string(sequenceCount) + ",tokensPerSequence=" + std::to_string(tokensPerSequence), iterations, elapsedMs(startTime));
+
+    llama_batch_free(batch);
+}
+
+// mirrors AddonModel::Detokenize called once per generated token by a detokenizer stream
+static void benchDetokenize(const llama_vocab * vocab) {
+    const int vocabSize = llama_vocab_n_tokens(vocab);
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<llama_token> distribution(0, vocabSize - 1);
+
+    std::vector<llama_token> tokens(4096);
+    for (auto & token : tokens) {
+        token = distribution(generator);
+    }
+
+    std::string result;
+    uint64_t totalChars = 0;
+
+    const uint64_t iterations = 100;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        for (size_t tokenIndex = 0; tokenIndex < tokens.size(); tokenIndex++) {
+            result.resize(std::max(result.capacity(), (size_t)64));
+
+            int n_chars = llama_detokenize(vocab, &tokens[tokenIndex], 1, &result[0], result.size(), false, false);
+            if (n_chars < 0) {
+                result.resize(-n_chars);
+                n_chars = llama_detokenize(vocab, &tokens[tokenIndex], 1, &result[0], result.size(), false, false);
+            }
+
+            totalChars += n_chars;
+        }
+    }
+
+    report("detokenizeStreaming", "tokens=" + std::to_string(tokens.size() * iterations), iterations, elapsedMs(startTime));
+    (void)totalChars;
+}
+
+// mirrors the getSequenceState/setSequenceState workers - full state serialization roundtrip
+static void benchStateSaveLoad(llama_model * model) {
+    auto contextParams = llama_context_default_params();
+    contextParams.n_ctx = 2048;
+    contextParams.no_perf = true;
+
+    llama_context * ctx = llama_init_from_model(model, contextParams);
+    if (ctx == nullptr) {
+        fprintf(stderr, "skipping stateSaveLoad: failed to create a context\n");
+        return;
+    }
+
+    const size_t stateSize = llama_state_get_size(ctx);
+    std::vector<uint8_t> state(stateSize);
+
+    const uint64_t iterations = 10;
+    const auto saveStartTime = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        llama_state_get_data(ctx, state.data(), state.size());
+    }
+    report("stateSave", "stateSize=" + std::to_string(stateSize), iterations, elapsedMs(saveStartTime));
+
+    const auto loadStartTime = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        llama_state_set_data(ctx, state.data(), state.size());
+    }
+    report("stateLoad", "stateSize=" + std::to_string(stateSize), iterations, elapsedMs(loadStartTime));
+
+    llama_free(ctx);
+}
+
+int main(int argc, char ** argv) {
+    llama_backend_init();
+    llama_log_set([](ggml_log_level, const char *, void *) {}, nullptr);
+
+    for (const int vocabSize : {32000, 65536, 131072, 262144}) {
+        benchSamplerApply(vocabSize);
+    }
+
+    for (const int sequenceCount : {1, 4, 16, 64}) {
+        benchBatchAdd(sequenceCount);
+    }
+
+    if (argc > 1) {
+        auto modelParams = llama_model_default_params();
+        llama_model * model = llama_model_load_from_file(argv[1], modelParams);
+
+        if (model == nullptr) {
+            fprintf(stderr, "failed to load model \"%s\"\n", argv[1]);
+        } else {
+            benchDetokenize(llama_model_get_vocab(model));
+            benchStateSaveLoad(model);
+            llama_model_free(model);
+        }
+    } else {
+        fprintf(stderr, "no model path given - skipping detokenize and state save/load benchmarks\n");
+    }
+
+    printf("{\"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto & result = results[i];
+        printf(
+            "%s\n  {\"name\": \"%s\", \"params\": \"%s\", \"iterations\": %llu, \"totalMs\": %.3f, \"msPerOp\": %.6f}",
+            i == 0 ? "" : ",",
+            result.name.c_str(),
+            result.params.c_str(),
+            (unsigned long long)result.iterations,
+            result.totalMs,
+            result.totalMs / result.iterations
+        );
+    }
+    printf("\n]}\n");
+
+    llama_backend_free();
+    return 0;
+}
@@ -7,10 +7,14 @@ export type BindingModule = {
         new (modelPath: string, params: {
             addonExports?: BindingModule,
             gpuLayers?: number,
+            mainGpu?: number,
+            splitMode?: "none" | "layer" | "row",
+            tensorSplit?: number[],
             vocabOnly?: boolean,
             useMmap?: boolean,
             useMlock?: boolean,
             checkTensors?: boolean,
+            prefetch?: boolean,
             onLoadProgress?(loadPercentage: number): void,
             hasLoadAbortSignal?: boolean,
             overridesList?: Array<[key: string, value: number | bigint | boolean | string, type: 0 | 1 | undefined]>
@@ -52,7 +56,16 @@ export type BindingModule = {
             ranking?: boolean,
             threads?: number,
             performanceTracking?: boolean,
-            swaFullCache?: boolean
+            swaFullCache?: boolean,
+
+            // run decode operations on a persistent dedicated thread instead of queueing
+            // an async worker on the libuv thread pool for every call
+            dedicatedInferenceThread?: boolean,
+
+            // on dispose, return the native context to a warm pool on the model
+            // instead of freeing it, so a new context with the same options
+            // reuses the existing KV cache allocation
+            pooled?: boolean
         }): AddonContext
     },
     AddonGrammar: {
@@ -65,9 +78,29 @@ export type BindingModule = {
         new (model: AddonModel, grammar: AddonGrammar): AddonGrammarEvaluationState,
         new (existingState: AddonGrammarEvaluationState): AddonGrammarEvaluationState
     },
+    AddonDetokenizerStream: {
+        new (model: AddonModel): AddonDetokenizerStream
+    },
+    AddonThreadpool: {
+        new (options?: {
+            threads?: number,
+
+            // CPU indexes the pool threads are allowed to run on,
+            // for pinning a context's compute threads to a single NUMA node
+            cpuMask?: number[],
+            strictCpu?: boolean,
+            priority?: "normal" | "medium" | "high" | "realtime",
+            poll?: number
+        }): AddonThreadpool
+    },
     AddonSampler: {
         new (model: AddonModel): AddonSampler,
         acceptGrammarEvaluationStateToken(grammarEvaluationState: AddonGrammarEvaluationState, token: Token): void,
+
+        // applies the grammar across the entire vocabulary in one native pass.
+        // returns a packed bitmask with one bit per token - bit (token % 8) of byte (token / 8)
+        // is set when the token is admissible in the current grammar state
+        computeGrammarMask(grammarEvaluationState: AddonGrammarEvaluationState): Uint8Array,
         canBeNextTokenForGrammarEvaluationState(grammarEvaluationState: AddonGrammarEvaluationState, token: Token): boolean
     },
     systemInfo(): string,
@@ -89,24 +122,50 @@ export type BindingModule = {
     },
     setLogger(logger: (level: number, message: string) => void): void,
     setLoggerLogLevel(level: number): void,
+    getLoggerDroppedLogCount(): number,
     getGpuVramInfo(): {
         total: number,
         used: number,
-        unifiedSize: number
+        unifiedSize: number,
+        devices: Array<{
+            name: string,
+            total: number,
+            used: number
+        }>,
+        ageMs: number
     },
     getGpuDeviceInfo(): {
-        deviceNames: string[]
+        deviceNames: string[],
+        devices: Array<{
+            index: number,
+            name: string,
+            description: string,
+            totalMemory: number,
+            freeMemory: number
+        }>
     },
     getGpuType(): "cuda" | "vulkan" | "metal" | false | undefined,
     ensureGpuDeviceIsSupported(): void,
     getSwapInfo(): {
         total: number,
         maxSize: number,
-        free: number
+        free: number,
+        ageMs: number
     },
     getMemoryInfo(): {
-        total: number
+        total: number,
+        ageMs: number
     },
+    startResourceMonitor(
+        options?: {
+            intervalMs?: number,
+            memoryUsageThreshold?: number,
+            swapUsedThreshold?: number,
+            vramUsedThreshold?: number
+        },
+        onThresholdCrossing?: (resource: "memory" | "swap" | "vram", exceeded: boolean, value: number, threshold: number) => void
+    ): void,
+    stopResourceMonitor(): void,
     init(): Promise<void>,
     setNuma(numa?: LlamaNuma): void,
     loadBackends(forceLoadLibrariesSearchPath?: string): void,
@@ -138,7 +197,18 @@ export type BindingModule = {
         sampleRate: number,
         channels: number,
         duration: number
-    }>
+    }>,
+
+    // Embedding cache controls. The cache is process-wide,
+    // so worker threads sharing a vision model also share it
+    setEmbeddingCacheSize(maxSize: number): void,
+    getEmbeddingCacheState(): {
+        hitCount: number,
+        missCount: number,
+        entryCount: number,
+        usedSize: number,
+        maxSize: number
+    }
 };
 
 export type AddonModel = {
@@ -147,6 +217,14 @@ export type AddonModel = {
     abortActiveModelLoad(): void,
     dispose(): Promise<void>,
     tokenize(text: string, specialTokens: boolean): Uint32Array,
+
+    // tokenizes all inputs in one native call, parallelized across hardware threads.
+    // Buffer inputs are tokenized in place without a UTF-8 re-copy.
+    // the tokens of input i are tokens[offsets[i]] through tokens[offsets[i + 1] - 1]
+    tokenizeBatch(inputs: (string | Buffer)[], specialTokens: boolean): Promise<{
+        tokens: Uint32Array,
+        offsets: Uint32Array
+    }>,
     detokenize(tokens: Uint32Array, specialTokens?: boolean): string,
     getTrainContextSize(): number,
     getEmbeddingVectorSize(): number,
@@ -168,6 +246,7 @@ export type AddonModel = {
     shouldPrependBosToken(): boolean,
     shouldAppendEosToken(): boolean,
     getModelSize(): number,
+    getVocabHash(): string,
 
     // Multimodal methods
     processImageNative?(imageData: Uint8Array, width: number, height: number): Promise<Float32Array>,
@@ -194,20 +273,83 @@ export type AddonContext = {
     dispose(): Promise<void>,
     getContextSize(): number,
     initBatch(size: number): void, // size must be less or equal to batchSize
+
+    // grow the batch allocation up-front so subsequent initBatch calls with smaller sizes reuse it
+    reserveBatch(maxTokens: number): void,
+
+    // release the batch allocation. use under memory pressure; the next initBatch call reallocates
+    shrinkBatch(): void,
     addToBatch(
         sequenceId: number,
         firstTokenSequenceIndex: number,
         tokens: Uint32Array,
         logitIndexes: Uint32Array,
     ): Uint32Array, // returns an array with batchLogitIndex for each item in the logitIndexes array
+
+    // populates the whole batch from one flat buffer containing a
+    // (seqId, firstPos, tokenCount, logitIndexCount, logitIndexes..., tokens...) record per sequence,
+    // replacing a separate addToBatch call per sequence.
+    // returns an array with the batchLogitIndex for every requested logit index, in record order
+    setBatch(packedBatch: Uint32Array): Uint32Array,
     decodeBatch(): Promise<void>,
     sampleToken(batchLogitIndex: BatchLogitIndex, sampler: AddonSampler): Promise<Token | -1>,
     sampleToken(
         batchLogitIndex: BatchLogitIndex,
         sampler: AddonSampler,
         probabilities: boolean,
-        confidence?: boolean
-    ): Promise<[token: Token | -1, probabilities: (Token | number)[] | undefined, confidence: number | undefined]>,
+        confidence?: boolean,
+        maxProbabilities?: number // limit the number of returned probabilities to the top tokens. 0 = no limit
+    ): Promise<[
+        token: Token | -1,
+        probabilities: [tokens: Uint32Array, probabilities: Float32Array] | undefined,
+        confidence: number | undefined
+    ]>,
+
+    // samples all of the given logit indexes of the last decoded batch in one native call,
+    // using the sampler at the same index for each logit index.
+    // returns the sampled token for each logit index, or -1 when no token could be sampled
+    sampleTokens(batchLogitIndexes: Uint32Array, samplers: AddonSampler[]): Promise<Int32Array>,
+
+    // decodes the current batch and keeps sampling and decoding natively until a stop condition is met,
+    // so generating a token doesn't cost two thread pool round trips.
+    // returns all sampled tokens, including the stop token when one was sampled
+    decodeAndSample(batchLogitIndex: BatchLogitIndex, sampler: AddonSampler, options?: {
+        sequenceId?: number,
+        nextTokenContextIndex?: number,
+        maxTokens?: number,
+        stopTokens?: Uint32Array
+    }): Promise<Uint32Array>,
+
+    // runs decode->sample->accept iterations entirely natively until a stop condition is met,
+    // with incremental detokenization for stop-string matching.
+    // completed text chunks are streamed through onTextChunk, never splitting a stop string
+    // or an incomplete UTF-8 sequence across chunks
+    generate(batchLogitIndex: BatchLogitIndex, sampler: AddonSampler, options?: {
+        sequenceId?: number,
+        nextTokenContextIndex?: number,
+        maxTokens?: number,
+        stopTokens?: Uint32Array,
+        stopStrings?: string[]
+    }, onTextChunk?: (text: string) => void): Promise<{
+        tokens: Uint32Array,
+        stopReason: "maxTokens" | "eogToken" | "stopToken" | "stopString" | "noToken"
+    }>,
+
+    // runs the draft-generate -> target-verify -> accept/rollback loop natively on both contexts.
+    // the draft context must have the same token history evaluated as this context
+    speculativeDecode(batchLogitIndex: BatchLogitIndex, draftContext: AddonContext, sampler: AddonSampler, options?: {
+        sequenceId?: number,
+        draftSequenceId?: number,
+        nextTokenContextIndex?: number,
+        maxTokens?: number,
+        draftLength?: number,
+        stopTokens?: Uint32Array
+    }): Promise<{
+        tokens: Uint32Array,
+        stopReason: "maxTokens" | "eogToken" | "stopToken" | "noToken",
+        draftedTokenCount: number,
+        acceptedDraftTokenCount: number
+    }>,
     disposeSequence(sequenceId: number): void,
 
     // startPos in inclusive, endPos is exclusive
@@ -216,16 +358,65 @@ export type AddonContext = {
     // startPos in inclusive, endPos is exclusive
     shiftSequenceTokenCells(sequenceId: number, startPos: number, endPos: number, shiftDelta: number): void,
 
+    // share KV cells of `[startPos, endPos)` from one sequence with another.
+    // a metadata operation in the unified KV cache - no tokens are re-decoded
+    copySequenceKvCache(srcSequenceId: number, dstSequenceId: number, startPos: number, endPos: number): void,
+
+    // prompt prefix cache: register a decoded prefix once, then fork new sequences from it.
+    // forkSequenceFromKvCachePrefix returns the number of positions covered by the cached prefix
+    // (decoding should resume from there), or -1 when the prefix isn't registered
+    registerKvCachePrefix(sequenceId: number, prefixTokens: Uint32Array): void,
+    forkSequenceFromKvCachePrefix(sequenceId: number, prefixTokens: Uint32Array): number,
+    getKvCachePrefixStats(): {
+        registeredCount: number,
+        hitCount: number,
+        missCount: number
+    },
+
     getSequenceKvCacheMinPosition(sequenceId: number): number,
     getSequenceKvCacheMaxPosition(sequenceId: number): number,
-    getEmbedding(inputTokensLength: number, maxVectorSize?: number): Float64Array,
+    getEmbedding(inputTokensLength: number, maxVectorSize?: number): Float32Array,
+
+    // gather pooled embeddings for many sequences after a decode into one packed buffer.
+    // sequence `sequenceIds[i]` occupies `embeddings.subarray(i * stride, (i + 1) * stride)`
+    getEmbeddings(sequenceIds: number[], maxVectorSize?: number): {
+        embeddings: Float32Array,
+        stride: number,
+        sequenceCount: number
+    },
     getStateSize(): number,
     getThreads(): number,
     setThreads(threads: number): void,
+    reset(options?: {threads?: number}): void,
+    attachThreadpool(threadpool: AddonThreadpool, batchThreadpool?: AddonThreadpool): void,
+    detachThreadpool(): void,
     printTimings(): void,
+
+    // the llama.cpp timing fields (loadMs, promptMs, evalMs and their token counts)
+    // are only populated when the context was created with performanceTracking enabled;
+    // the addon-level counters are always collected
+    getPerfMetrics(): {
+        loadMs?: number,
+        promptTokenCount?: number,
+        promptMs?: number,
+        evalTokenCount?: number,
+        evalMs?: number,
+        decodeCallCount: number,
+        decodeTotalMs: number,
+        decodedTokenCount: number,
+        decodeBatchCapacityTokenCount: number,
+        decodeTimeHistogramBucketMaxMs: number[],
+        decodeTimeHistogramCounts: number[],
+        samplerCallCount: number,
+        samplerTotalMs: number,
+        queueWaitCallCount: number,
+        queueWaitTotalMs: number
+    },
     ensureDraftContextIsCompatibleForSpeculative(draftContext: AddonContext): void,
-    saveSequenceStateToFile(filePath: string, sequenceId: number, tokens: Uint32Array): Promise<number>,
+    saveSequenceStateToFile(filePath: string, sequenceId: number, tokens: Uint32Array, options?: {compressed?: boolean, deltaBase?: string}): Promise<number>,
     loadSequenceStateFromFile(filePath: string, sequenceId: number, maxContextSize: number): Promise<Uint32Array>,
+    getSequenceState(sequenceId: number): Promise<Uint8Array>,
+    setSequenceState(sequenceId: number, state: Uint8Array): Promise<void>,
     setLora(lora: AddonModelLora, scale: number): void
 };
 
@@ -233,6 +424,11 @@ export type BatchLogitIndex = number & {
     readonly __batchLogitIndex: never
 };
 
+export type AddonThreadpool = {
+    getThreadCount(): number,
+    dispose(): void
+};
+
 export type AddonGrammar = {
     isTextCompatible(testText: string): boolean
 };
@@ -241,6 +437,15 @@ export type AddonGrammarEvaluationState = "AddonGrammarEvaluationState" & {
     readonly __brand: never
 };
 
+// incremental detokenizer for streaming output.
+// the partial-UTF-8 tail is kept natively between pushes,
+// so only complete valid UTF-8 chunks are ever materialized as JS strings
+export type AddonDetokenizerStream = {
+    pushTokens(tokens: Uint32Array, decodeSpecialTokens?: boolean): string,
+    flush(): string,
+    dispose(): void
+};
+
 export type AddonSampler = {
     dispose(): void,
     applyConfig(config: {
@@ -252,12 +457,14 @@ export type AddonSampler = {
         repeatPenalty?: number,
         repeatPenaltyMaxTokens?: number,
         repeatPenaltyTokens?: Uint32Array,
+        repeatPenaltyNativeTokens?: boolean, // use the natively tracked token history instead of `repeatPenaltyTokens`
         repeatPenaltyPresencePenalty?: number, // alpha_presence
         repeatPenaltyFrequencyPenalty?: number, // alpha_frequency
         grammarEvaluationState?: AddonGrammarEvaluationState,
         tokenBiasKeys?: Uint32Array,
         tokenBiasValues?: Float32Array
-    }): void
+    }): void,
+    setTokenHistory(tokens: Uint32Array): void
 };
 
 export type AddonVisionModel = AddonModel & {
@@ -282,6 +489,18 @@ export type AddonAudioModel = {
         transcript?: string,
         confidence?: number
     }>,
+
+    // streaming input: chunks are resampled as they arrive, so only the model
+    // inference itself is left to run when the stream finishes.
+    // pushAudioChunk returns the number of buffered samples at the model's sample rate
+    pushAudioChunk(audioChunk: Float32Array, sampleRate: number): number,
+    finishAudioStream(options?: {
+        generateTranscript?: boolean
+    }): Promise<{
+        embedding: Float32Array,
+        transcript?: string,
+        confidence?: number
+    }>,
     getAudioCapabilities(): {
         maxAudioFiles: number,
         supportedFormats: string[],
@@ -1632,11 +1632,37 @@ export class LlamaContextSequence {
      * Save the current context sequence evaluation state to a file.
      * @see [Saving and restoring a context sequence evaluation state](https://node-llama-cpp.withcat.ai/guide/chat-session#save-and-restore-with-context-sequence-state)
      */
-    public async saveStateToFile(filePath: string) {
+    public async saveStateToFile(filePath: string, options?: {
+        /**
+         * Compress the state on the fly while writing it to the file.
+         *
+         * The state is written in chunks, so the memory overhead stays small,
+         * and the resulting file can be several times smaller.
+         *
+         * Compressed state files are detected and loaded automatically by `loadStateFromFile`.
+         *
+         * Defaults to `false`.
+         */
+        compressed?: boolean,
+
+        /**
+         * Save only the difference against an existing state file (created by a previous `saveStateToFile` call)
+         * instead of the full state, which makes periodic checkpoints of a long-running sequence much smaller and faster to write.
+         *
+         * The delta file records the path of the base file, and loading it replays the base file and the delta,
+         * so the base file (and its own bases, when chaining deltas) must remain available at the same path.
+         *
+         * The state saved with this option is always compressed.
+         */
+        deltaBase?: string
+    }) {
         /* eslint-enable @stylistic/max-len */
         this._ensureNotDisposed();
 
         const resolvedPath = path.resolve(process.cwd(), filePath);
+        const resolvedDeltaBasePath = options?.deltaBase != null
+            ? path.resolve(process.cwd(), options.deltaBase)
+            : undefined;
 
         const evaluatorLock = await acquireLock([this._lock, "evaluate"]);
         const contextLock = await acquireLock([this._context, "context"]);
@@ -1647,7 +1673,11 @@ export class LlamaContextSequence {
             const fileSize = await this._context._ctx.saveSequenceStateToFile(
                 resolvedPath,
                 this._sequenceId,
-                Uint32Array.from(this.contextTokens)
+                Uint32Array.from(this.contextTokens),
+                {
+                    compressed: options?.compressed ?? false,
+                    deltaBase: resolvedDeltaBasePath
+                }
             );
             return {fileSize};
         } finally {
@@ -2378,18 +2408,15 @@ function getTokenBiasesForAddon(tokenBias: undefined | TokenBias | (() => TokenB
     };
 }
 
-function reviveTokenProbabilities(probabilities?: (Token | number)[]) {
+function reviveTokenProbabilities(probabilities?: [tokens: Uint32Array, probabilities: Float32Array]) {
     if (probabilities == null)
         return undefined;
 
+    const [tokens, probs] = probabilities;
     const res = new Map<Token, number>();
 
-    for (let i = 1; i < probabilities.length; i += 2) {
-        const token = probabilities[i - 1]! as Token;
-        const probability = probabilities[i]! as number;
-
-        res.set(token, probability);
-    }
+    for (let i = 0; i < tokens.length; i++)
+        res.set(tokens[i]! as Token, probs[i]!);
 
     return res;
 }
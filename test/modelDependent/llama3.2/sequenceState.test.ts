@@ -294,6 +294,288 @@ describe("llama 3.2", () => {
 
                 expect(contextSequence2.contextTokens).to.eql([]);
             });
+
+            test("save and load a compressed state works properly", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const contextSequence = context.getSequence();
+
+                const chatSession = new LlamaChatSession({
+                    contextSequence
+                });
+
+                const res = await chatSession.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res).to.toMatchInlineSnapshot("\"That's a clever\"");
+
+
+                const rawStateFilePath = await getTempTestFilePath("rawState");
+                const compressedStateFilePath = await getTempTestFilePath("compressedState");
+                const stateTokens = contextSequence.contextTokens.slice();
+
+                const {fileSize: rawFileSize} = await contextSequence.saveStateToFile(rawStateFilePath);
+                test.onTestFinished(() => fs.remove(rawStateFilePath));
+
+                const {fileSize: compressedFileSize} = await contextSequence.saveStateToFile(compressedStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(compressedStateFilePath));
+
+                expect(compressedFileSize).to.eql((await fs.stat(compressedStateFilePath)).size);
+                expect(compressedFileSize).to.be.lessThan(rawFileSize);
+
+                await contextSequence.clearHistory();
+                expect(contextSequence.contextTokens).to.eql([]);
+
+                await contextSequence.loadStateFromFile(compressedStateFilePath, {acceptRisk: true});
+                expect(contextSequence.contextTokens).to.eql(stateTokens);
+
+                const chatSession2 = new LlamaChatSession({
+                    contextSequence
+                });
+                chatSession2.setChatHistory(chatSession.getChatHistory());
+                const res2 = await chatSession2.prompt("What did I tell you to remember?", {maxTokens: 12});
+                expect(res2).to.toMatchInlineSnapshot('"You told me to remember that "locks are not doors"."');
+            });
+
+            test("loading detects compressed and raw state files automatically", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const contextSequence = context.getSequence();
+
+                const chatSession = new LlamaChatSession({
+                    contextSequence
+                });
+
+                const res = await chatSession.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res).to.toMatchInlineSnapshot("\"That's a clever\"");
+
+
+                const rawStateFilePath = await getTempTestFilePath("rawState");
+                const compressedStateFilePath = await getTempTestFilePath("compressedState");
+                const stateTokens = contextSequence.contextTokens.slice();
+
+                await contextSequence.saveStateToFile(rawStateFilePath);
+                test.onTestFinished(() => fs.remove(rawStateFilePath));
+
+                await contextSequence.saveStateToFile(compressedStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(compressedStateFilePath));
+
+                await contextSequence.clearHistory();
+                await contextSequence.loadStateFromFile(rawStateFilePath, {acceptRisk: true});
+                expect(contextSequence.contextTokens).to.eql(stateTokens);
+
+                await contextSequence.clearHistory();
+                await contextSequence.loadStateFromFile(compressedStateFilePath, {acceptRisk: true});
+                expect(contextSequence.contextTokens).to.eql(stateTokens);
+            });
+
+            test("loading a truncated compressed state file fails", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const contextSequence = context.getSequence();
+
+                const chatSession = new LlamaChatSession({
+                    contextSequence
+                });
+
+                const res = await chatSession.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res).to.toMatchInlineSnapshot("\"That's a clever\"");
+
+
+                const compressedStateFilePath = await getTempTestFilePath("compressedState");
+                await contextSequence.saveStateToFile(compressedStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(compressedStateFilePath));
+
+                const fileSize = (await fs.stat(compressedStateFilePath)).size;
+                await fs.truncate(compressedStateFilePath, Math.floor(fileSize / 2));
+
+                await contextSequence.clearHistory();
+                try {
+                    await contextSequence.loadStateFromFile(compressedStateFilePath, {acceptRisk: true});
+                    expect.unreachable("Should have thrown an error");
+                } catch (err) {
+                    expect(err).to.be.instanceof(Error);
+                    expect((err as Error).message).to.include("Failed to read sequence snapshot file");
+                }
+
+                expect(contextSequence.contextTokens).to.eql([]);
+            });
+
+            test("save and load a delta state works properly", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const contextSequence = context.getSequence();
+
+                const chatSession = new LlamaChatSession({
+                    contextSequence
+                });
+
+                const res = await chatSession.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res).to.toMatchInlineSnapshot("\"That's a clever\"");
+
+                const baseStateFilePath = await getTempTestFilePath("baseState");
+                await contextSequence.saveStateToFile(baseStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(baseStateFilePath));
+
+                const res2 = await chatSession.prompt("Remember: giraffes are not elephants", {maxTokens: 4});
+                expect(res2.length).to.be.greaterThan(0);
+
+                const deltaStateFilePath = await getTempTestFilePath("deltaState");
+                const fullStateFilePath = await getTempTestFilePath("fullState");
+                const stateTokens = contextSequence.contextTokens.slice();
+
+                const {fileSize: deltaFileSize} = await contextSequence.saveStateToFile(deltaStateFilePath, {deltaBase: baseStateFilePath});
+                test.onTestFinished(() => fs.remove(deltaStateFilePath));
+
+                const {fileSize: fullFileSize} = await contextSequence.saveStateToFile(fullStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(fullStateFilePath));
+
+                // the delta only stores the difference against the base state
+                expect(deltaFileSize).to.be.lessThan(fullFileSize);
+
+                await contextSequence.clearHistory();
+                expect(contextSequence.contextTokens).to.eql([]);
+
+                await contextSequence.loadStateFromFile(deltaStateFilePath, {acceptRisk: true});
+                expect(contextSequence.contextTokens).to.eql(stateTokens);
+
+                const chatSession2 = new LlamaChatSession({
+                    contextSequence
+                });
+                chatSession2.setChatHistory(chatSession.getChatHistory());
+                const res3 = await chatSession2.prompt("What did I tell you to remember first?", {maxTokens: 12});
+                expect(res3.length).to.be.greaterThan(0);
+            });
+
+            test("loading a delta state replays a chain of deltas", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const contextSequence = context.getSequence();
+
+                const chatSession = new LlamaChatSession({
+                    contextSequence
+                });
+
+                const res = await chatSession.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res).to.toMatchInlineSnapshot("\"That's a clever\"");
+
+                const baseStateFilePath = await getTempTestFilePath("baseState");
+                await contextSequence.saveStateToFile(baseStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(baseStateFilePath));
+
+                const res2 = await chatSession.prompt("Remember: giraffes are not elephants", {maxTokens: 4});
+                expect(res2.length).to.be.greaterThan(0);
+
+                const delta1StateFilePath = await getTempTestFilePath("delta1State");
+                await contextSequence.saveStateToFile(delta1StateFilePath, {deltaBase: baseStateFilePath});
+                test.onTestFinished(() => fs.remove(delta1StateFilePath));
+
+                const res3 = await chatSession.prompt("Remember: chairs are not tables", {maxTokens: 4});
+                expect(res3.length).to.be.greaterThan(0);
+
+                const delta2StateFilePath = await getTempTestFilePath("delta2State");
+                const stateTokens = contextSequence.contextTokens.slice();
+
+                // a delta can use another delta as its base, forming a chain
+                await contextSequence.saveStateToFile(delta2StateFilePath, {deltaBase: delta1StateFilePath});
+                test.onTestFinished(() => fs.remove(delta2StateFilePath));
+
+                await contextSequence.clearHistory();
+                expect(contextSequence.contextTokens).to.eql([]);
+
+                await contextSequence.loadStateFromFile(delta2StateFilePath, {acceptRisk: true});
+                expect(contextSequence.contextTokens).to.eql(stateTokens);
+            });
+
+            test("loading a delta state fails when its base file is missing or modified", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const contextSequence = context.getSequence();
+
+                const chatSession = new LlamaChatSession({
+                    contextSequence
+                });
+
+                const res = await chatSession.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res).to.toMatchInlineSnapshot("\"That's a clever\"");
+
+                const baseStateFilePath = await getTempTestFilePath("baseState");
+                await contextSequence.saveStateToFile(baseStateFilePath, {compressed: true});
+                test.onTestFinished(() => fs.remove(baseStateFilePath));
+
+                const res2 = await chatSession.prompt("Remember: giraffes are not elephants", {maxTokens: 4});
+                expect(res2.length).to.be.greaterThan(0);
+
+                const deltaStateFilePath = await getTempTestFilePath("deltaState");
+                await contextSequence.saveStateToFile(deltaStateFilePath, {deltaBase: baseStateFilePath});
+                test.onTestFinished(() => fs.remove(deltaStateFilePath));
+
+                await contextSequence.clearHistory();
+
+                const baseStateFileContent = await fs.readFile(baseStateFilePath);
+                await fs.remove(baseStateFilePath);
+
+                try {
+                    await contextSequence.loadStateFromFile(deltaStateFilePath, {acceptRisk: true});
+                    expect.unreachable("Should have thrown an error");
+                } catch (err) {
+                    expect(err).to.be.instanceof(Error);
+                    expect((err as Error).message).to.include("Failed to open file");
+                }
+                expect(contextSequence.contextTokens).to.eql([]);
+
+                // a truncated base file must fail the delta load as well
+                await fs.writeFile(baseStateFilePath, baseStateFileContent.subarray(0, Math.floor(baseStateFileContent.length / 2)));
+
+                try {
+                    await contextSequence.loadStateFromFile(deltaStateFilePath, {acceptRisk: true});
+                    expect.unreachable("Should have thrown an error");
+                } catch (err) {
+                    expect(err).to.be.instanceof(Error);
+                    expect((err as Error).message).to.include("Failed to read sequence snapshot file");
+                }
+                expect(contextSequence.contextTokens).to.eql([]);
+            });
         });
     });
 });